@@ -0,0 +1,466 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+#include <crawl_cluster.h>
+#include <url_mgr.h>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+
+extern "C" {
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <endian.h>
+}
+
+Url_hash_ring::Url_hash_ring(int num_nodes, int vnodes_per_node) {
+    for (int node = 0; node < num_nodes; ++node) {
+        for (int vnode = 0; vnode < vnodes_per_node; ++vnode) {
+            ring_.emplace_back(hash(std::to_string(node) + "#" + std::to_string(vnode)), node);
+        }
+    }
+    std::sort(ring_.begin(), ring_.end());
+}
+
+// FNV-1a, so that every node process computes the same hash
+uint64_t Url_hash_ring::hash(const Url_t& str) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c: str) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    // Finalize to spread nearby strings around the ring
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+int Url_hash_ring::owner(const Url_t& page_path) const {
+    if (ring_.empty()) return 0;
+    auto iter = std::lower_bound(ring_.begin(), ring_.end(),
+        std::make_pair(hash(page_path), 0));
+    return iter == ring_.end() ? ring_.front().second : iter->second;
+}
+
+static bool write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::recv(fd, data, size, 0);
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Swaps between host and network byte order, which is its own inverse
+template <class Int_t>
+static Int_t network_order(Int_t val) {
+    if constexpr (sizeof(val) == 2) {
+        return static_cast<Int_t>(htons(static_cast<uint16_t>(val)));
+    }
+    else if constexpr (sizeof(val) == 4) {
+        return static_cast<Int_t>(htonl(static_cast<uint32_t>(val)));
+    }
+    else if constexpr (sizeof(val) == 8) {
+        return static_cast<Int_t>(htobe64(static_cast<uint64_t>(val)));
+    }
+    return val;
+}
+
+// Integers are sent in network byte order, so nodes on different architectures agree
+template <class Int_t>
+static void put_int(std::string& buf, Int_t val) {
+    val = network_order(val);
+    buf.append(reinterpret_cast<const char*>(&val), sizeof(val));
+}
+
+template <class Int_t>
+static bool get_int(const std::string& buf, size_t& pos, Int_t& val) {
+    if (pos + sizeof(val) > buf.size()) return false;
+    std::memcpy(&val, buf.data() + pos, sizeof(val));
+    val = network_order(val);
+    pos += sizeof(val);
+    return true;
+}
+
+static bool get_str(const std::string& buf, size_t& pos, std::string& str) {
+    uint32_t len;
+    if (!get_int(buf, pos, len) or pos + len > buf.size()) return false;
+    str.assign(buf, pos, len);
+    pos += len;
+    return true;
+}
+
+Crawl_cluster_node::Crawl_cluster_node(int node_id, const Cluster_node_addrs_t& nodes,
+    const Url_canon_rules& canon_rules, size_t batch_size) : node_id_(node_id), 
+    batch_size_(batch_size), canon_(canon_rules), ring_(static_cast<int>(nodes.size())), round_statuses_(nodes.size()) {
+    for (const Cluster_node_addr& addr: nodes) {
+        peers_.emplace_back(std::make_unique<Peer>());
+        peers_.back()->addr = addr;
+    }
+    last_flush_ = std::chrono::steady_clock::now();
+}
+
+Crawl_cluster_node::~Crawl_cluster_node() {
+    stop();
+}
+
+bool Crawl_cluster_node::start() {
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        std::cout << "cluster error: creating the listening socket" << std::endl;
+        return false;
+    }
+    int reuse = 1;
+    ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<uint16_t>(peers_[node_id_]->addr.port));
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 or
+        ::listen(listen_fd_, static_cast<int>(peers_.size()) + 4) < 0) {
+        std::cout << "cluster error: listening on port " <<
+            peers_[node_id_]->addr.port << std::endl;
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    running_ = true;
+    accept_thread_ = std::thread(&Crawl_cluster_node::accept_connections, this);
+    if (node_id_ == 0) {
+        coordinator_thread_ = std::thread(&Crawl_cluster_node::coordinate_termination, this);
+    }
+    return true;
+}
+
+void Crawl_cluster_node::stop() {
+    if (!running_.exchange(false)) return;
+    round_cv_.notify_all();
+    ::shutdown(listen_fd_, SHUT_RDWR);
+    ::close(listen_fd_);
+    if (accept_thread_.joinable()) accept_thread_.join();
+    if (coordinator_thread_.joinable()) coordinator_thread_.join();
+    {
+        std::lock_guard lock(state_mutex_);
+        for (int fd: reader_fds_) {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+    }
+    for (std::thread& t: reader_threads_) {
+        t.join();
+    }
+    for (int fd: reader_fds_) {
+        ::close(fd);
+    }
+    for (auto& peer: peers_) {
+        // A crawling thread may still be sending a batch to the peer
+        std::lock_guard lock(peer->send_mutex);
+        if (peer->fd >= 0) {
+            ::close(peer->fd);
+            peer->fd = -1;
+        }
+    }
+}
+
+// Every variant of a page hashes to the same node, so only that node's Url_mgr dedups it
+Url_t Crawl_cluster_node::owner_key(const Page_path_t& path) const {
+    return canon_.dedup_key(path);
+}
+
+bool Crawl_cluster_node::owns(const Page_path_t& path) const {
+    return ring_.owner(owner_key(path)) == node_id_;
+}
+
+void Crawl_cluster_node::forward_paths(const Page_paths_t& paths) {
+    bool flush_partial;
+    {
+        std::lock_guard lock(state_mutex_);
+        for (const Page_path_t& path: paths) {
+            int owner = ring_.owner(owner_key(path));
+            peers_[owner]->batch.push_back(path);
+        }
+        // Don't let a busy node sit on partial batches the other nodes are waiting for
+        flush_partial = std::chrono::steady_clock::now() - last_flush_ > batch_flush_interval;
+    }
+    flush_batches(flush_partial);
+}
+
+Page_paths_t Crawl_cluster_node::take_received_paths() {
+    Page_paths_t paths;
+    std::lock_guard lock(state_mutex_);
+    paths.swap(received_paths_);
+    if (!paths.empty()) {
+        locally_idle_ = false;
+    }
+    return paths;
+}
+
+bool Crawl_cluster_node::is_cluster_done() {
+    {
+        std::lock_guard lock(state_mutex_);
+        locally_idle_ = true;
+    }
+    flush_batches(true);
+    return terminated_ or peers_.size() <= 1;
+}
+
+Crawl_cluster_node::Node_status Crawl_cluster_node::local_status() {
+    std::lock_guard lock(state_mutex_);
+    bool idle = locally_idle_ and received_paths_.empty();
+    for (auto& peer: peers_) {
+        idle = idle and peer->batch.empty();
+    }
+    return Node_status{idle, batches_sent_, batches_received_};
+}
+
+void Crawl_cluster_node::flush_batches(bool flush_partial) {
+    std::vector<std::pair<int, Page_paths_t>> ready;
+    {
+        std::lock_guard lock(state_mutex_);
+        for (size_t node = 0; node < peers_.size(); ++node) {
+            Page_paths_t& batch = peers_[node]->batch;
+            if (!batch.empty() and (flush_partial or batch.size() >= batch_size_)) {
+                ready.emplace_back(static_cast<int>(node), Page_paths_t{});
+                ready.back().second.swap(batch);
+                // Count the batch as sent before it goes out, so the termination
+                // check can't see the cluster as idle while it's in flight
+                ++batches_sent_;
+            }
+        }
+        if (flush_partial) {
+            last_flush_ = std::chrono::steady_clock::now();
+        }
+    }
+    for (auto& [node, batch]: ready) {
+        send_message(node, msg_paths, encode_paths(batch));
+    }
+}
+
+std::string Crawl_cluster_node::encode_paths(const Page_paths_t& paths) {
+    std::string payload;
+    for (const Page_path_t& path: paths) {
+        put_int(payload, static_cast<int32_t>(path.depth));
+        put_int(payload, static_cast<uint32_t>(path.path.size()));
+        payload.append(path.path);
+        put_int(payload, static_cast<uint32_t>(path.page.size()));
+        payload.append(path.page);
+        put_int(payload, static_cast<uint32_t>(path.query.size()));
+        payload.append(path.query);
+    }
+    return payload;
+}
+
+Page_paths_t Crawl_cluster_node::decode_paths(const std::string& payload) {
+    Page_paths_t paths;
+    size_t pos = 0;
+    while (pos < payload.size()) {
+        Page_path_t path;
+        int32_t depth;
+        if (!get_int(payload, pos, depth) or !get_str(payload, pos, path.path) or
+            !get_str(payload, pos, path.page) or !get_str(payload, pos, path.query)) break;  // Malformed
+        path.depth = depth;
+        paths.push_back(std::move(path));
+    }
+    return paths;
+}
+
+bool Crawl_cluster_node::send_message(int node_id, uint32_t type, const std::string& payload) {
+    Peer& peer = *peers_[node_id];
+    std::lock_guard lock(peer.send_mutex);
+    // Peers may still be starting, so keep retrying the connection while running
+    while (peer.fd < 0 and running_) {
+        addrinfo hints{}, *result = nullptr;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (::getaddrinfo(peer.addr.host.c_str(), std::to_string(peer.addr.port).c_str(),
+            &hints, &result) == 0) {
+            int fd = ::socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+            if (fd >= 0 and ::connect(fd, result->ai_addr, result->ai_addrlen) == 0) {
+                int no_delay = 1;
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+                peer.fd = fd;
+            }
+            else if (fd >= 0) {
+                ::close(fd);
+            }
+            ::freeaddrinfo(result);
+        }
+        if (peer.fd < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    if (peer.fd < 0) return false;
+    std::string msg;
+    put_int(msg, type);
+    put_int(msg, static_cast<uint32_t>(payload.size()));
+    msg.append(payload);
+    if (!write_all(peer.fd, msg.data(), msg.size())) {
+        std::cout << "cluster error: sending to node " << node_id << std::endl;
+        ::close(peer.fd);
+        peer.fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void Crawl_cluster_node::accept_connections() {
+    while (running_) {
+        int fd = ::accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) continue;
+        std::lock_guard lock(state_mutex_);
+        if (!running_) {
+            ::close(fd);
+            break;
+        }
+        reader_fds_.push_back(fd);
+        reader_threads_.emplace_back(&Crawl_cluster_node::read_messages, this, fd);
+    }
+}
+
+void Crawl_cluster_node::read_messages(int fd) {
+    while (running_) {
+        uint32_t header[2];
+        if (!read_all(fd, reinterpret_cast<char*>(header), sizeof(header))) break;
+        header[0] = ntohl(header[0]);
+        header[1] = ntohl(header[1]);
+        if (header[1] > max_payload_bytes) {
+            std::cout << "cluster error: dropping a peer that sent a " << header[1] << 
+                " byte message" << std::endl;
+            ::shutdown(fd, SHUT_RDWR);
+            break;
+        }
+        std::string payload(header[1], '\0');
+        if (!read_all(fd, payload.data(), payload.size())) break;
+        handle_message(header[0], payload);
+    }
+}
+
+void Crawl_cluster_node::handle_message(uint32_t type, const std::string& payload) {
+    switch (type) {
+        case msg_paths: {
+            Page_paths_t paths = decode_paths(payload);
+            std::lock_guard lock(state_mutex_);
+            received_paths_.insert(received_paths_.end(),
+                std::make_move_iterator(paths.begin()), std::make_move_iterator(paths.end()));
+            ++batches_received_;
+            break;
+        }
+        case msg_status_request: {
+            Node_status status = local_status();
+            std::string response = payload;  // Echo the round
+            put_int(response, static_cast<int32_t>(node_id_));
+            put_int(response, static_cast<uint8_t>(status.idle));
+            put_int(response, status.sent);
+            put_int(response, status.received);
+            send_message(0, msg_status, response);
+            break;
+        }
+        case msg_status: {
+            size_t pos = 0;
+            uint64_t round;
+            int32_t node;
+            uint8_t idle;
+            Node_status status;
+            if (get_int(payload, pos, round) and get_int(payload, pos, node) and
+                get_int(payload, pos, idle) and get_int(payload, pos, status.sent) and
+                get_int(payload, pos, status.received) and
+                node >= 0 and node < static_cast<int32_t>(round_statuses_.size())) {
+                status.idle = idle != 0;
+                std::lock_guard lock(round_mutex_);
+                if (round == round_) {
+                    round_statuses_[node] = status;
+                    round_cv_.notify_all();
+                }
+            }
+            break;
+        }
+        case msg_terminate: {
+            terminated_ = true;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+bool Crawl_cluster_node::collect_round(uint64_t round, std::vector<Node_status>& statuses) {
+    {
+        std::lock_guard lock(round_mutex_);
+        round_ = round;
+        std::fill(round_statuses_.begin(), round_statuses_.end(), std::nullopt);
+        round_statuses_[0] = local_status();
+    }
+    std::string request;
+    put_int(request, round);
+    for (size_t node = 1; node < peers_.size(); ++node) {
+        send_message(static_cast<int>(node), msg_status_request, request);
+    }
+    std::unique_lock lock(round_mutex_);
+    bool complete = round_cv_.wait_for(lock, std::chrono::seconds(1), [this] {
+        return !running_ or std::all_of(round_statuses_.begin(), round_statuses_.end(),
+            [](const auto& status) { return status.has_value(); });
+    });
+    if (!complete or !running_) return false;
+    statuses.clear();
+    for (const auto& status: round_statuses_) {
+        statuses.push_back(*status);
+    }
+    return true;
+}
+
+// Four counter termination detection: the cluster is done when every node is idle
+// and the totals of batches sent and received match and are unchanged over two rounds.
+void Crawl_cluster_node::coordinate_termination() {
+    uint64_t round = 0;
+    std::optional<std::pair<uint64_t, uint64_t>> prev_totals;
+    while (running_ and !terminated_) {
+        std::this_thread::sleep_for(status_poll_interval);
+        std::vector<Node_status> statuses;
+        if (!collect_round(++round, statuses)) {
+            prev_totals.reset();
+            continue;
+        }
+        bool all_idle = true;
+        uint64_t sent = 0, received = 0;
+        for (const Node_status& status: statuses) {
+            all_idle = all_idle and status.idle;
+            sent += status.sent;
+            received += status.received;
+        }
+        if (!all_idle or sent != received) {
+            prev_totals.reset();
+            continue;
+        }
+        if (prev_totals and *prev_totals == std::make_pair(sent, received)) {
+            terminated_ = true;
+            for (size_t node = 1; node < peers_.size(); ++node) {
+                send_message(static_cast<int>(node), msg_terminate, "");
+            }
+        }
+        prev_totals = std::make_pair(sent, received);
+    }
+}
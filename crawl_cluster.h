@@ -0,0 +1,148 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <optional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <web_common.h>
+#include <url_canon.h>
+
+struct Cluster_node_addr {
+    std::string host;
+    int port;
+};
+
+using Cluster_node_addrs_t = std::vector<Cluster_node_addr>;
+
+/// @brief Consistent hash ring that maps a page path to the node that owns it
+class Url_hash_ring {
+public:
+    /// @param num_nodes [in] Number of nodes in the cluster
+    /// @param vnodes_per_node [in] Virtual nodes per node. More evens out the partitions.
+    Url_hash_ring(int num_nodes, int vnodes_per_node = 64);
+    int owner(const Url_t& page_path) const;
+    static uint64_t hash(const Url_t& str);
+private:
+    std::vector<std::pair<uint64_t, int>> ring_;
+};
+
+/// @brief One node of a distributed crawl.
+/// Each node crawls the paths it owns with its own Url_mgr shard and forwards
+/// the links it finds for the other nodes over TCP in batches.
+/// Node 0 coordinates the detection of global termination.
+class Crawl_cluster_node {
+public:
+    /// @param node_id [in] This node's index in nodes
+    /// @param nodes [in] Listening addresses of every node in the cluster, in node id order
+    /// @param canon_rules [in] The crawl's canonicalization rules. Every node must use 
+    /// the same ones, so that every variant of a page has the same owner.
+    /// @param batch_size [in] Number of paths buffered for a node before they are sent
+    Crawl_cluster_node(int node_id, const Cluster_node_addrs_t& nodes,
+        const Url_canon_rules& canon_rules = Url_canon_rules{}, size_t batch_size = 256);
+    ~Crawl_cluster_node();
+
+    /// @brief Starts listening for the other nodes
+    /// @return false when the listening socket can't be set up
+    bool start();
+    void stop();
+
+    int node_id() const {
+        return node_id_;
+    }
+    bool owns(const Page_path_t& path) const;
+
+    /// @brief Queue paths owned by other nodes for forwarding.
+    /// This method can be called concurrently by multiple threads.
+    void forward_paths(const Page_paths_t& paths);
+
+    /// @brief Takes the paths other nodes have forwarded to this node
+    Page_paths_t take_received_paths();
+
+    /// @brief Called while this node's crawler has nothing to do.
+    /// Flushes any partially filled batches.
+    /// @return true once every node in the cluster has finished crawling
+    bool is_cluster_done();
+
+private:
+    enum Msg_type : uint32_t {
+        msg_paths = 1,
+        msg_status_request,
+        msg_status,
+        msg_terminate
+    };
+    struct Node_status {
+        bool idle;
+        uint64_t sent;
+        uint64_t received;
+    };
+    struct Peer {
+        Cluster_node_addr addr;
+        int fd{-1};
+        std::mutex send_mutex;
+        Page_paths_t batch;
+    };
+    static constexpr auto status_poll_interval = std::chrono::milliseconds(50);
+    static constexpr auto batch_flush_interval = std::chrono::milliseconds(100);
+    // Far above any real batch. A peer that claims more is dropped, 
+    // rather than having this node allocate whatever it asks for.
+    static constexpr uint32_t max_payload_bytes{64 * 1024 * 1024};
+
+    const int node_id_;
+    const size_t batch_size_;
+    const Url_canonicalizer canon_;
+    Url_hash_ring ring_;
+    std::vector<std::unique_ptr<Peer>> peers_;
+    int listen_fd_{-1};
+    std::atomic_bool running_{false};
+    std::atomic_bool terminated_{false};
+    std::thread accept_thread_;
+    std::thread coordinator_thread_;
+    std::list<std::thread> reader_threads_;
+    std::vector<int> reader_fds_;
+
+    // Guards the received paths, the idle flag, the batch buffers and the counters,
+    // so that a status snapshot is consistent
+    std::mutex state_mutex_;
+    Page_paths_t received_paths_;
+    bool locally_idle_{false};
+    uint64_t batches_sent_{0};
+    uint64_t batches_received_{0};
+    std::chrono::steady_clock::time_point last_flush_;
+
+    // Node 0 collects the status responses for the current round
+    std::mutex round_mutex_;
+    std::condition_variable round_cv_;
+    uint64_t round_{0};
+    std::vector<std::optional<Node_status>> round_statuses_;
+
+    Url_t owner_key(const Page_path_t& path) const;
+    void accept_connections();
+    void read_messages(int fd);
+    void coordinate_termination();
+    bool collect_round(uint64_t round, std::vector<Node_status>& statuses);
+    void handle_message(uint32_t type, const std::string& payload);
+    Node_status local_status();
+    bool send_message(int node_id, uint32_t type, const std::string& payload);
+    void flush_batches(bool flush_partial);
+    static std::string encode_paths(const Page_paths_t& paths);
+    static Page_paths_t decode_paths(const std::string& payload);
+};
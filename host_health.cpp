@@ -0,0 +1,154 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+
+#include <host_health.h>
+#include <algorithm>
+#include <random>
+
+Host_health::Host_health(const Host_health_config& config) : config_(config) {}
+
+bool Host_health::is_retryable(int http_code) {
+    switch (http_code) {
+        case http_request_timeout:
+        case http_too_many_requests:
+        case http_internal_error:
+        case http_bad_gateway:
+        case http_service_unavailable:
+        case http_gateway_timeout:
+            return true;
+        default:
+            return false;
+    }
+}
+
+long Host_health::deadline_ms(const std::string& host) {
+    std::lock_guard lock(mutex_);
+    return deadline_ms(hosts_[host]);
+}
+
+long Host_health::deadline_ms(const Host_state& state) const {
+    if (state.latencies.size() < config_.min_latency_samples) {
+        return config_.max_deadline_ms;
+    }
+    long deadline = static_cast<long>(state.p99_ms * config_.deadline_p99_factor);
+    return std::clamp(deadline, config_.min_deadline_ms, config_.max_deadline_ms);
+}
+
+Host_health::Time_point_t Host_health::parked_until(const std::string& host, Time_point_t now,
+    bool* probe_ptr) {
+    std::lock_guard lock(mutex_);
+    Host_state& state = hosts_[host];
+    if (probe_ptr) {
+        *probe_ptr = false;
+    }
+    switch (state.breaker) {
+        case breaker_open:
+            if (now < state.open_until) {
+                return state.open_until;
+            }
+            // Let one probe request find out whether the host has recovered
+            state.breaker = breaker_half_open;
+            if (probe_ptr) {
+                *probe_ptr = true;
+            }
+            return now;
+        case breaker_half_open:
+            // Check back shortly, the probe decides what happens next
+            return now + std::chrono::milliseconds(config_.backoff_base_ms);
+        default:
+            return now;
+    }
+}
+
+void Host_health::return_probe(const std::string& host) {
+    std::lock_guard lock(mutex_);
+    Host_state& state = hosts_[host];
+    if (state.breaker == breaker_half_open) {
+        // open_until has passed, so the probe is handed out again right away
+        state.breaker = breaker_open;
+    }
+}
+
+void Host_health::record(const std::string& host, std::chrono::milliseconds latency, 
+    bool success, Time_point_t now) {
+    std::lock_guard lock(mutex_);
+    Host_state& state = hosts_[host];
+    ++state.num_requests;
+    if (success) {
+        uint32_t latency_ms = static_cast<uint32_t>(std::max<long>(0, latency.count()));
+        if (state.latencies.size() < latency_window) {
+            state.latencies.push_back(latency_ms);
+        }
+        else {
+            state.latencies[state.next_latency] = latency_ms;
+        }
+        state.next_latency = (state.next_latency + 1) % latency_window;
+        // Sorting the window for every request would be wasteful
+        if (++state.new_latencies >= percentile_refresh_interval or
+            state.latencies.size() <= config_.min_latency_samples) {
+            refresh_percentiles(state);
+        }
+        state.consecutive_failures = 0;
+        if (state.breaker == breaker_half_open) {
+            state.breaker = breaker_closed;
+            state.open_ms = 0;
+        }
+    }
+    else {
+        ++state.num_failures;
+        ++state.consecutive_failures;
+        if (state.breaker == breaker_half_open or 
+            (state.breaker == breaker_closed and 
+                state.consecutive_failures >= config_.breaker_failure_threshold)) {
+            open_breaker(state, now);
+        }
+    }
+}
+
+void Host_health::open_breaker(Host_state& state, Time_point_t now) {
+    state.open_ms = state.open_ms == 0 ? config_.breaker_open_ms :
+        std::min(state.open_ms * 2, config_.breaker_max_open_ms);
+    state.open_until = now + std::chrono::milliseconds(state.open_ms);
+    state.breaker = breaker_open;
+    ++state.num_breaker_trips;
+}
+
+void Host_health::refresh_percentiles(Host_state& state) {
+    std::vector<uint32_t> sorted = state.latencies;
+    std::sort(sorted.begin(), sorted.end());
+    state.p50_ms = sorted[(sorted.size() - 1) / 2];
+    state.p99_ms = sorted[(sorted.size() - 1) * 99 / 100];
+    state.new_latencies = 0;
+}
+
+std::chrono::milliseconds Host_health::retry_delay(int retry) const {
+    // Full jitter spreads out the retries of pages that failed together
+    thread_local std::mt19937 rand_gen{std::random_device{}()};
+    long max_delay = config_.backoff_base_ms << std::min(retry, 20);
+    max_delay = std::min(max_delay, config_.backoff_max_ms);
+    std::uniform_int_distribution<long> delay_dist(0, std::max(0L, max_delay));
+    return std::chrono::milliseconds(delay_dist(rand_gen));
+}
+
+std::vector<Host_latency_stats> Host_health::stats() {
+    std::lock_guard lock(mutex_);
+    std::vector<Host_latency_stats> all_stats;
+    for (auto& [host, state]: hosts_) {
+        if (state.new_latencies > 0) {
+            refresh_percentiles(state);
+        }
+        all_stats.push_back(Host_latency_stats{host, state.num_requests, state.num_failures,
+            state.num_breaker_trips, state.p50_ms, state.p99_ms, deadline_ms(state)});
+    }
+    return all_stats;
+}
@@ -0,0 +1,131 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <web_common.h>
+
+struct Host_health_config {
+    // Request deadlines are the host's p99 latency times this factor,
+    // clamped to [min_deadline_ms, max_deadline_ms]
+    double deadline_p99_factor{3.0};
+    long min_deadline_ms{1000};
+    long max_deadline_ms{20000};
+    // Latencies needed before the deadline adapts. Until then it's max_deadline_ms.
+    size_t min_latency_samples{16};
+    // Retries of a page after a timeout or a transient server error
+    int max_retries{2};
+    // Retry delays are random in [0, min(backoff_max_ms, backoff_base_ms * 2^retry)]
+    long backoff_base_ms{200};
+    long backoff_max_ms{5000};
+    // Consecutive failures that open the host's circuit breaker
+    int breaker_failure_threshold{5};
+    // How long an open breaker parks the host's pages. Doubles each time
+    // the breaker reopens, up to breaker_max_open_ms.
+    long breaker_open_ms{2000};
+    long breaker_max_open_ms{30000};
+};
+
+struct Host_latency_stats {
+    std::string host;
+    uint64_t num_requests;
+    uint64_t num_failures;
+    uint64_t num_breaker_trips;
+    long p50_ms;
+    long p99_ms;
+    long deadline_ms;
+};
+
+/// @brief Tracks the latency and failures of each host the crawler reads from.
+/// Derives per request deadlines from the observed p99 latency, jittered retry
+/// delays, and runs a circuit breaker per host. A host whose breaker is open
+/// is parked: its pages wait until the breaker lets a probe request through.
+/// This class is thread safe.
+class Host_health {
+public:
+    using Clock_t = std::chrono::steady_clock;
+    using Time_point_t = Clock_t::time_point;
+
+    Host_health(const Host_health_config& config = Host_health_config{});
+
+    const Host_health_config& config() const {
+        return config_;
+    }
+
+    /// @brief Timeouts and transient server errors are worth retrying
+    static bool is_retryable(int http_code);
+
+    /// @brief Deadline in ms for the next request to the host
+    long deadline_ms(const std::string& host);
+
+    /// @brief Checks whether a request to the host can go ahead
+    /// @param probe_ptr [out] Set to whether this call handed out the open breaker's
+    /// probe. A probe that isn't used must be given back with return_probe.
+    /// @return The time to wait until when the host is parked, else now
+    Time_point_t parked_until(const std::string& host, Time_point_t now = Clock_t::now(),
+        bool* probe_ptr = nullptr);
+
+    /// @brief Gives back a probe that no request was sent for, so the next 
+    /// check can hand it out again
+    void return_probe(const std::string& host);
+
+    /// @brief Records the outcome of a request to the host
+    /// @param latency [in] Time the request took
+    /// @param success [in] false for timeouts and retryable errors
+    void record(const std::string& host, std::chrono::milliseconds latency, bool success,
+        Time_point_t now = Clock_t::now());
+
+    /// @brief Random delay before a retry, with exponential backoff
+    /// @param retry [in] 0 for the first retry
+    std::chrono::milliseconds retry_delay(int retry) const;
+
+    std::vector<Host_latency_stats> stats();
+
+private:
+    enum Breaker_state {
+        breaker_closed,
+        breaker_open,
+        // The open period elapsed and one probe request is in flight
+        breaker_half_open
+    };
+    enum { latency_window = 512, percentile_refresh_interval = 32 };
+    struct Host_state {
+        // Ring of the most recent latencies in ms
+        std::vector<uint32_t> latencies;
+        size_t next_latency{0};
+        size_t new_latencies{0};
+        long p50_ms{0};
+        long p99_ms{0};
+        uint64_t num_requests{0};
+        uint64_t num_failures{0};
+        uint64_t num_breaker_trips{0};
+        int consecutive_failures{0};
+        Breaker_state breaker{breaker_closed};
+        long open_ms{0};
+        Time_point_t open_until;
+    };
+
+    const Host_health_config config_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, Host_state> hosts_;
+
+    long deadline_ms(const Host_state& state) const;
+    void open_breaker(Host_state& state, Time_point_t now);
+    static void refresh_percentiles(Host_state& state);
+};
@@ -0,0 +1,210 @@
+/***
+ # Released under the MIT License
+ 
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ ***/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <tuple>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+
+struct Cpu_info {
+    int cpu;
+    int core;
+    int package;
+    int numa_node;
+};
+
+enum Thread_placement_policy {
+    // Threads run wherever the scheduler puts them
+    placement_none,
+    // Fill a core's hardware threads, then the next core, staying on one socket as long as possible
+    placement_compact,
+    // Spread threads across the sockets and cores before sharing any core
+    placement_scatter,
+    // Use the CPUs in the order listed
+    placement_explicit
+};
+
+struct Thread_placement {
+    Thread_placement_policy policy{placement_none};
+    // CPUs for placement_explicit
+    std::vector<int> cpus;
+};
+
+/// @brief The machine's CPUs and how they group into cores, sockets and NUMA nodes, 
+/// as reported by Linux in /sys
+class Cpu_topology {
+public:
+    Cpu_topology(std::vector<Cpu_info> cpus) : cpus_(std::move(cpus)) {}
+
+    /// @brief Reads the topology of the online CPUs. 
+    /// Without /sys, every CPU is its own core on one socket and NUMA node.
+    static Cpu_topology detect() {
+        std::vector<Cpu_info> cpus;
+        std::vector<int> online = parse_cpu_list(read_sys_file("cpu/online"));
+        std::vector<int> cpu_nodes;
+        for (int node = 0; ; ++node) {
+            std::string node_cpus = read_sys_file("node/node" + std::to_string(node) + "/cpulist");
+            if (node_cpus.empty()) break;
+            for (int cpu: parse_cpu_list(node_cpus)) {
+                if (cpu >= static_cast<int>(cpu_nodes.size())) {
+                    cpu_nodes.resize(cpu + 1, 0);
+                }
+                cpu_nodes[cpu] = node;
+            }
+        }
+        if (online.empty()) {
+            for (int cpu = 0; cpu < static_cast<int>(std::thread::hardware_concurrency()); ++cpu) {
+                online.push_back(cpu);
+            }
+        }
+        for (int cpu: online) {
+            std::string topology_dir = "cpu/cpu" + std::to_string(cpu) + "/topology/";
+            std::string core = read_sys_file(topology_dir + "core_id");
+            std::string package = read_sys_file(topology_dir + "physical_package_id");
+            cpus.push_back(Cpu_info{cpu, core.empty() ? cpu : std::stoi(core),
+                package.empty() ? 0 : std::stoi(package),
+                cpu < static_cast<int>(cpu_nodes.size()) ? cpu_nodes[cpu] : 0});
+        }
+        return Cpu_topology(std::move(cpus));
+    }
+
+    /// @brief Parses Linux CPU lists like 0-3,8,10-11
+    static std::vector<int> parse_cpu_list(const std::string& cpu_list) {
+        std::vector<int> cpus;
+        std::istringstream list_stream(cpu_list);
+        std::string range;
+        while (std::getline(list_stream, range, ',')) {
+            if (range.empty() or !std::isdigit(static_cast<unsigned char>(range.front()))) continue;
+            size_t dash_pos = range.find('-');
+            int first = std::stoi(range.substr(0, dash_pos));
+            int last = dash_pos == std::string::npos ? first : std::stoi(range.substr(dash_pos + 1));
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    const std::vector<Cpu_info>& cpus() const {
+        return cpus_;
+    }
+    int num_cpus() const {
+        return static_cast<int>(cpus_.size());
+    }
+    int num_cores() const {
+        return count_distinct([](const Cpu_info& info) { 
+            return std::make_pair(info.package, info.core); });
+    }
+    int num_packages() const {
+        return count_distinct([](const Cpu_info& info) { return info.package; });
+    }
+    int num_numa_nodes() const {
+        return count_distinct([](const Cpu_info& info) { return info.numa_node; });
+    }
+    /// @brief The NUMA node of the CPU, or 0 when it's unknown
+    int numa_node(int cpu) const {
+        auto iter = std::find_if(cpus_.begin(), cpus_.end(), 
+            [cpu](const Cpu_info& info) { return info.cpu == cpu; });
+        return iter == cpus_.end() ? 0 : iter->numa_node;
+    }
+
+    /// @brief The CPUs in the order threads are assigned to them.
+    /// Thread i runs on CPU i % size. Empty for placement_none.
+    std::vector<int> placement_cpus(const Thread_placement& placement) const {
+        std::vector<int> cpus;
+        std::vector<Cpu_info> ordered = cpus_;
+        std::sort(ordered.begin(), ordered.end(), [](const Cpu_info& a, const Cpu_info& b) {
+            return std::tie(a.numa_node, a.package, a.core, a.cpu) < 
+                std::tie(b.numa_node, b.package, b.core, b.cpu);
+        });
+        if (placement.policy == placement_explicit) {
+            cpus = placement.cpus;
+        }
+        else if (placement.policy == placement_compact) {
+            for (const Cpu_info& info: ordered) {
+                cpus.push_back(info.cpu);
+            }
+        }
+        else if (placement.policy == placement_scatter) {
+            // Each node's CPUs: the first hardware thread of every core, then the second ones...
+            std::map<int, std::vector<std::vector<int>>> node_core_cpus;
+            for (size_t i = 0; i < ordered.size(); ++i) {
+                auto& core_cpus = node_core_cpus[ordered[i].numa_node];
+                if (i == 0 or ordered[i - 1].numa_node != ordered[i].numa_node or
+                    ordered[i - 1].package != ordered[i].package or 
+                    ordered[i - 1].core != ordered[i].core) {
+                    core_cpus.emplace_back();
+                }
+                core_cpus.back().push_back(ordered[i].cpu);
+            }
+            std::vector<std::vector<int>> node_cpus;
+            for (const auto& [node, core_cpus]: node_core_cpus) {
+                node_cpus.emplace_back();
+                for (size_t thread_rank = 0; ; ++thread_rank) {
+                    size_t num_before = node_cpus.back().size();
+                    for (const std::vector<int>& core: core_cpus) {
+                        if (thread_rank < core.size()) {
+                            node_cpus.back().push_back(core[thread_rank]);
+                        }
+                    }
+                    if (node_cpus.back().size() == num_before) break;
+                }
+            }
+            // ...dealt out one node at a time
+            for (size_t i = 0; cpus.size() < ordered.size(); ++i) {
+                for (const std::vector<int>& one_node_cpus: node_cpus) {
+                    if (i < one_node_cpus.size()) {
+                        cpus.push_back(one_node_cpus[i]);
+                    }
+                }
+            }
+        }
+        return cpus;
+    }
+
+    /// @brief E.g. "2 sockets, 16 cores, 32 CPUs, 2 NUMA nodes"
+    std::string summary() const {
+        return std::to_string(num_packages()) + (num_packages() == 1 ? " socket, " : " sockets, ") +
+            std::to_string(num_cores()) + (num_cores() == 1 ? " core, " : " cores, ") +
+            std::to_string(num_cpus()) + (num_cpus() == 1 ? " CPU, " : " CPUs, ") +
+            std::to_string(num_numa_nodes()) + 
+            (num_numa_nodes() == 1 ? " NUMA node" : " NUMA nodes");
+    }
+
+private:
+    std::vector<Cpu_info> cpus_;
+
+    static std::string read_sys_file(const std::string& path) {
+        std::ifstream in("/sys/devices/system/" + path);
+        std::string line;
+        std::getline(in, line);
+        return line;
+    }
+
+    template <class Key_fcn_t>
+    int count_distinct(Key_fcn_t key_fcn) const {
+        std::set<decltype(key_fcn(cpus_.front()))> keys;
+        for (const Cpu_info& info: cpus_) {
+            keys.insert(key_fcn(info));
+        }
+        return static_cast<int>(keys.size());
+    }
+};
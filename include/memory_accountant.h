@@ -0,0 +1,147 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+enum Memory_use {
+    // Page bodies being read and processed
+    memory_page_buffers,
+    // Links extracted from pages, before they reach the frontier
+    memory_link_batches,
+    // Work processors have queued, e.g. for a background thread
+    memory_processor_work,
+    num_memory_uses
+};
+
+struct Memory_stats {
+    size_t current_bytes;
+    size_t peak_bytes;
+    // 0 is unlimited
+    size_t budget_bytes;
+    // Times a fetch waited for memory to be released
+    uint64_t num_paused_fetches;
+};
+
+/// @brief Counts the bytes a crawl holds in memory, by use, against a budget.
+/// The counts are atomic, so any thread can charge and release bytes without locking.
+/// Only try_charge enforces the budget; charge always succeeds, for memory
+/// that is already held.
+class Memory_accountant {
+public:
+    Memory_accountant(size_t budget_bytes = 0) : budget_bytes_(budget_bytes) {}
+    Memory_accountant(const Memory_accountant&) = delete;
+    Memory_accountant& operator=(const Memory_accountant&) = delete;
+
+    /// @brief Set while no bytes are charged
+    void set_budget(size_t budget_bytes) {
+        budget_bytes_ = budget_bytes;
+    }
+    void charge(Memory_use use, size_t bytes) {
+        use_bytes_[use].fetch_add(bytes, std::memory_order_relaxed);
+        update_peak(current_bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    }
+    /// @brief Charges the bytes only if they fit in the budget
+    bool try_charge(Memory_use use, size_t bytes) {
+        size_t current = current_bytes_.load(std::memory_order_relaxed);
+        do {
+            if (budget_bytes_ != 0 and current + bytes > budget_bytes_) {
+                return false;
+            }
+        } while (!current_bytes_.compare_exchange_weak(current, current + bytes, 
+            std::memory_order_relaxed));
+        use_bytes_[use].fetch_add(bytes, std::memory_order_relaxed);
+        update_peak(current + bytes);
+        return true;
+    }
+    void release(Memory_use use, size_t bytes) {
+        use_bytes_[use].fetch_sub(bytes, std::memory_order_relaxed);
+        current_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+    /// @brief Whether charging bytes more stays within the budget
+    bool has_room(size_t bytes) const {
+        return budget_bytes_ == 0 or 
+            current_bytes_.load(std::memory_order_relaxed) + bytes <= budget_bytes_;
+    }
+    void note_paused_fetch() {
+        num_paused_fetches_.fetch_add(1, std::memory_order_relaxed);
+    }
+    size_t current_bytes() const {
+        return current_bytes_.load(std::memory_order_relaxed);
+    }
+    size_t current_bytes(Memory_use use) const {
+        return use_bytes_[use].load(std::memory_order_relaxed);
+    }
+    /// @brief Starts the peak over at the current usage, and clears the pause count
+    void reset_stats() {
+        peak_bytes_ = current_bytes_.load();
+        num_paused_fetches_ = 0;
+    }
+    Memory_stats stats() const {
+        return Memory_stats{current_bytes_.load(), peak_bytes_.load(), budget_bytes_, 
+            num_paused_fetches_.load()};
+    }
+
+private:
+    size_t budget_bytes_;
+    std::atomic<size_t> current_bytes_{0};
+    std::atomic<size_t> peak_bytes_{0};
+    std::atomic<size_t> use_bytes_[num_memory_uses]{};
+    std::atomic<uint64_t> num_paused_fetches_{0};
+
+    void update_peak(size_t current) {
+        size_t peak = peak_bytes_.load(std::memory_order_relaxed);
+        while (current > peak and 
+            !peak_bytes_.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {}
+    }
+};
+
+/// @brief Holds a charge of bytes to a Memory_accountant, and releases it when destroyed
+class Memory_charge {
+public:
+    Memory_charge(Memory_accountant& accountant, Memory_use use, size_t bytes = 0) :
+        accountant_(accountant), use_(use), bytes_(bytes) {
+        accountant_.charge(use_, bytes_);
+    }
+    /// @brief Takes over bytes already charged, e.g. by try_charge
+    Memory_charge(Memory_accountant& accountant, Memory_use use, size_t bytes, std::adopt_lock_t) :
+        accountant_(accountant), use_(use), bytes_(bytes) {}
+    ~Memory_charge() {
+        accountant_.release(use_, bytes_);
+    }
+    Memory_charge(const Memory_charge&) = delete;
+    Memory_charge& operator=(const Memory_charge&) = delete;
+
+    /// @brief Changes the charge to bytes, e.g. once a reservation's real size is known
+    void resize(size_t bytes) {
+        if (bytes > bytes_) {
+            accountant_.charge(use_, bytes - bytes_);
+        }
+        else {
+            accountant_.release(use_, bytes_ - bytes);
+        }
+        bytes_ = bytes;
+    }
+    size_t bytes() const {
+        return bytes_;
+    }
+
+private:
+    Memory_accountant& accountant_;
+    const Memory_use use_;
+    size_t bytes_;
+};
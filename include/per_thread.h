@@ -0,0 +1,69 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+/// @brief Gives each thread its own instance of T, so threads can accumulate
+/// results without locking. The instances are merged after the threads are done.
+template <class T>
+class Per_thread {
+public:
+    /// @brief The calling thread's instance.
+    /// Only the first call from a thread takes a lock. The instance is constructed
+    /// by its thread, so a pinned thread's instance is on its own NUMA node.
+    T& local() {
+        // Shared by every Per_thread<T> the thread uses, so the items are keyed by id_
+        struct Thread_items {
+            // The last one used, so the usual call skips the map
+            int last_id{-1};
+            T* last_item_ptr{nullptr};
+            std::unordered_map<int, T*> item_ptrs;
+        };
+        static thread_local Thread_items thread_items;
+        if (thread_items.last_id != id_) {
+            T*& item_ptr = thread_items.item_ptrs[id_];
+            if (!item_ptr) {
+                std::lock_guard lock(mutex_);
+                items_.emplace_back();
+                item_ptr = &items_.back();
+            }
+            thread_items.last_id = id_;
+            thread_items.last_item_ptr = item_ptr;
+        }
+        return *thread_items.last_item_ptr;
+    }
+
+    /// @brief Calls fcn(T&) for every thread's instance.
+    /// The threads must not be using their instances concurrently.
+    template <class Fcn_t>
+    void for_each(Fcn_t fcn) {
+        std::lock_guard lock(mutex_);
+        for (T& item: items_) {
+            fcn(item);
+        }
+    }
+
+private:
+    static int next_id() {
+        static std::atomic_int id{0};
+        return id++;
+    }
+    // Distinguishes this object from earlier ones in the thread's cache
+    const int id_{next_id()};
+    std::mutex mutex_;
+    std::list<T> items_;
+};
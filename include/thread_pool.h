@@ -15,10 +15,38 @@ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR I
 #include <thread>
 #include <atomic>
 #include <semaphore>
+#include <vector>
+
+extern "C" {
+#include <pthread.h>
+#include <sched.h>
+}
 
 /// @brief Thread pool runs specified function(s) in the pool's threads
 class Thread_pool {
 public:
+    /// @brief Pin the pool's threads to CPUs. Thread i runs on cpus[i % cpus.size()].
+    /// Threads pin themselves before running their function, so memory they 
+    /// touch first, like Per_thread instances, is allocated on their NUMA node.
+    /// @param cpus [in] The CPUs in assignment order, see Cpu_topology::placement_cpus(). 
+    /// Empty leaves the threads unpinned.
+    void set_cpus(const std::vector<int>& cpus) {
+        cpus_ = cpus;
+    }
+
+    /// @brief Number of the last run's threads that couldn't be pinned to their CPU, 
+    /// e.g. because it's outside the process's cpuset. They run unpinned.
+    int num_pin_failures() const {
+        return num_pin_failures_;
+    }
+
+    /// @brief Stop the running threads. Each thread exits when its current call
+    /// to the function returns, rather than calling it again.
+    /// Threads blocked inside the function must be woken by the caller.
+    void stop() {
+        running_enabled_ = false;
+    }
+
     /// @brief Run the shared function specified in the ctor until the function returns false.
     /// @param fcn [in] Function or functor that runs concurrently in the pool's threads. 
     /// The function signature is bool fcn() or bool operator()(). 
@@ -28,6 +56,9 @@ public:
     /// @throws Can throw a std::system_error when a system error occurs while creating the pool's threads.
     template <class Fcn_t> requires std::invocable<Fcn_t>
     void run(Fcn_t fcn, int num_threads) {
+        num_started_ = 0;
+        num_pin_failures_ = 0;
+        running_enabled_ = true;
         start_threads_from_fcn(fcn, num_threads);
         run_threads_to_completion();
     }
@@ -44,6 +75,9 @@ public:
     void run(In_iter_t beg, In_iter_t end) {
         using category = typename std::iterator_traits<In_iter_t>::iterator_category;
         static_assert(std::is_base_of_v<std::input_iterator_tag, category>);        
+        num_started_ = 0;
+        num_pin_failures_ = 0;
+        running_enabled_ = true;
         start_threads_from_iter(beg, end);
         run_threads_to_completion();
     }
@@ -55,6 +89,9 @@ private:
     std::atomic_bool running_enabled_{true};
     std::atomic_int running_count_{0};
     Semaphore_t finished_sem_{0};
+    std::vector<int> cpus_;
+    int num_started_{0};
+    std::atomic_int num_pin_failures_{0};
 
     template <class Fcn_t>
     void start_threads_from_fcn(Fcn_t& fcn, int num_threads) {
@@ -78,10 +115,16 @@ private:
         Wrapped_fcn(Fcn_t& fcn,
             std::atomic_bool& running_enabled,
             std::atomic_int& running_count,
-            Semaphore_t& finished_sem) 
+            Semaphore_t& finished_sem,
+            std::atomic_int& num_pin_failures,
+            int cpu) 
             : fcn_(fcn), running_enabled_(running_enabled), 
-              running_count_(running_count), finished_sem_(finished_sem) {}
+              running_count_(running_count), finished_sem_(finished_sem), 
+              num_pin_failures_(num_pin_failures), cpu_(cpu) {}
         void operator() () {
+            if (cpu_ >= 0) {
+                pin_to_cpu();
+            }
             while (running_enabled_ && fcn_()) {}
             --running_count_;
             finished_sem_.release();
@@ -92,12 +135,25 @@ private:
         std::atomic_bool& running_enabled_;
         std::atomic_int& running_count_;
         Semaphore_t& finished_sem_;
+        std::atomic_int& num_pin_failures_;
+        int cpu_;
+
+        void pin_to_cpu() {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(cpu_, &cpu_set);
+            // A CPU that isn't available leaves the thread unpinned, which is still correct
+            if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0) {
+                ++num_pin_failures_;
+            }
+        }
     };
 
     template <class Fcn_t>
     void start_thread(Fcn_t& fcn) {
+        int cpu = cpus_.empty() ? -1 : cpus_[num_started_++ % cpus_.size()];
         Wrapped_fcn wrapped_fcn(fcn, running_enabled_, 
-            running_count_, finished_sem_);
+            running_count_, finished_sem_, num_pin_failures_, cpu);
         try {
             ++running_count_;
             std::thread t(wrapped_fcn);
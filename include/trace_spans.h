@@ -0,0 +1,186 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <fstream>
+#include <ostream>
+#include <per_thread.h>
+
+struct Trace_event {
+    // A string literal, it isn't copied
+    const char* name;
+    // Nanoseconds since the tracer was enabled
+    int64_t begin_ns;
+    int64_t end_ns;
+};
+
+/// @brief One thread's most recent trace events. Once full, each event replaces the oldest.
+class Trace_ring {
+public:
+    Trace_ring() : thread_num_(next_thread_num()) {}
+
+    void record(const Trace_event& event, size_t capacity) {
+        if (events_.empty()) {
+            events_.resize(capacity);
+        }
+        events_[num_recorded_ % events_.size()] = event;
+        ++num_recorded_;
+    }
+    /// @brief Calls fcn(const Trace_event&) for the kept events, oldest first
+    template <class Fcn_t>
+    void for_each(Fcn_t fcn) const {
+        size_t num_kept = std::min(num_recorded_, events_.size());
+        for (size_t i = num_recorded_ - num_kept; i < num_recorded_; ++i) {
+            fcn(events_[i % events_.size()]);
+        }
+    }
+    void clear() {
+        num_recorded_ = 0;
+    }
+    size_t num_recorded() const {
+        return num_recorded_;
+    }
+    int thread_num() const {
+        return thread_num_;
+    }
+
+private:
+    std::vector<Trace_event> events_;
+    size_t num_recorded_{0};
+    const int thread_num_;
+
+    static int next_thread_num() {
+        static std::atomic_int thread_num{1};
+        return thread_num++;
+    }
+};
+
+/// @brief Collects timed spans from every thread into per-thread ring buffers,
+/// without locking, and writes them as Chrome trace event JSON.
+/// The JSON loads into Perfetto (ui.perfetto.dev) or chrome://tracing.
+/// Recording is off until enable() is called. Off, a span costs one relaxed atomic load.
+class Tracer {
+public:
+    using Clock_t = std::chrono::steady_clock;
+
+    /// @brief The tracer that Trace_span records to by default
+    static Tracer& global() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    /// @brief Starts a new trace, dropping the events of any earlier one.
+    /// Times stay relative to the tracer's creation, so a span that was open 
+    /// across a disable() and enable() still ends after it began.
+    /// @param events_per_thread [in] Ring buffer size. Older events are dropped.
+    void enable(size_t events_per_thread = 64 * 1024) {
+        events_per_thread_ = std::max<size_t>(1, events_per_thread);
+        clear();
+        enabled_.store(true, std::memory_order_release);
+    }
+    void disable() {
+        enabled_.store(false, std::memory_order_release);
+    }
+    bool is_enabled() const {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+    int64_t now_ns() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock_t::now() - start_time_).count();
+    }
+    void record(const char* name, int64_t begin_ns, int64_t end_ns) {
+        rings_.local().record(Trace_event{name, begin_ns, end_ns}, events_per_thread_);
+    }
+
+    // The rest must not run while threads are recording
+
+    /// @brief Number of events kept in all the rings
+    size_t num_events() {
+        size_t num_events = 0;
+        rings_.for_each([&num_events](const Trace_ring& ring) {
+            ring.for_each([&num_events](const Trace_event&) { ++num_events; });
+        });
+        return num_events;
+    }
+    void clear() {
+        rings_.for_each([](Trace_ring& ring) { ring.clear(); });
+    }
+    /// @brief Writes the events as complete ("X") events, one track per thread
+    void write_chrome_json(std::ostream& out) {
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        const char* separator = "\n";
+        rings_.for_each([&out, &separator](const Trace_ring& ring) {
+            if (ring.num_recorded() == 0) return;
+            out << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << 
+                ring.thread_num() << ",\"args\":{\"name\":\"thread " << ring.thread_num() << "\"}}";
+            separator = ",\n";
+            ring.for_each([&out, &ring](const Trace_event& event) {
+                // record() takes any times, so keep them from going negative
+                int64_t begin_ns = std::max<int64_t>(0, event.begin_ns);
+                int64_t dur_ns = std::max<int64_t>(0, event.end_ns - begin_ns);
+                // Chrome's timestamps are microseconds
+                out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << 
+                    ring.thread_num() << ",\"ts\":" << begin_ns / 1000 << "." << 
+                    pad_ns(begin_ns % 1000) << ",\"dur\":" << dur_ns / 1000 << "." << 
+                    pad_ns(dur_ns % 1000) << "}";
+            });
+        });
+        out << "\n]}\n";
+    }
+    bool write_chrome_json(const std::string& file_path) {
+        std::ofstream out(file_path, std::ios::trunc);
+        write_chrome_json(out);
+        out.close();
+        return static_cast<bool>(out);
+    }
+
+private:
+    std::atomic_bool enabled_{false};
+    size_t events_per_thread_{64 * 1024};
+    const Clock_t::time_point start_time_{Clock_t::now()};
+    Per_thread<Trace_ring> rings_;
+
+    static std::string pad_ns(int64_t ns) {
+        std::string digits = std::to_string(ns);
+        return std::string(3 - digits.size(), '0') + digits;
+    }
+};
+
+/// @brief Records the time from its construction to its destruction as a span.
+/// Spans in the same thread nest.
+class Trace_span {
+public:
+    /// @param name [in] A string literal naming the phase
+    Trace_span(const char* name, Tracer& tracer = Tracer::global()) : 
+        tracer_(tracer), name_(tracer.is_enabled() ? name : nullptr),
+        begin_ns_(name_ ? tracer.now_ns() : 0) {}
+    ~Trace_span() {
+        if (name_) {
+            tracer_.record(name_, begin_ns_, tracer_.now_ns());
+        }
+    }
+    Trace_span(const Trace_span&) = delete;
+    Trace_span& operator=(const Trace_span&) = delete;
+
+private:
+    Tracer& tracer_;
+    const char* const name_;
+    const int64_t begin_ns_;
+};
@@ -0,0 +1,251 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+#include <link_graph.h>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <barrier>
+#include <url_mgr.h>
+
+Link_graph_processor::Link_graph_processor(int num_threads, const Url_canon_rules& canon_rules,
+    double damping, int max_iterations) : num_threads_(std::max(num_threads, 1)), 
+    canon_(canon_rules), damping_(damping), max_iterations_(max_iterations) {}
+
+// The same dedup key the frontier uses, so a page's variants are one node
+Url_t Link_graph_processor::page_key(const Url_t& site_domain, 
+    const Page_path_t& page_path) const {
+    return site_domain + canon_.dedup_key(page_path);
+}
+
+Url_t Link_graph_processor::page_key(const Url_t& url) const {
+    Deconstructed_url decon_url = Url_mgr::deconstruct_url(url);
+    if (decon_url.path.empty()) {
+        return url;
+    }
+    Page_path_t page_path{decon_url.path, decon_url.page, 0, decon_url.query};
+    canon_.canonicalize(page_path);
+    return page_key(Url_canonicalizer::canonical_domain(decon_url.domain), page_path);
+}
+
+Page_id_t Link_graph_processor::page_id(const Url_t& key, const Url_t& url) {
+    Id_shard& shard = id_shard(key);
+    std::lock_guard lock(shard.mutex);
+    auto iter = shard.ids.find(key);
+    if (iter != shard.ids.end()) {
+        return iter->second;
+    }
+    Page_id_t id = next_id_++;
+    shard.ids.emplace(key, id);
+    shard.urls.emplace_back(id, url);
+    return id;
+}
+
+std::optional<Page_id_t> Link_graph_processor::find_id(const Url_t& url) const {
+    auto iter = url_ids_.find(page_key(url));
+    return iter == url_ids_.end() ? std::nullopt : std::optional<Page_id_t>(iter->second);
+}
+
+// The edges are charged by capacity, which only changes when the vector grows
+void Link_graph_processor::charge_edges(Thread_edges& thread_edges, size_t old_capacity) {
+    if (thread_edges.edges.capacity() != old_capacity) {
+        charge_work(thread_edges.charge, thread_edges.edges.capacity() * sizeof(Edge_t));
+    }
+}
+
+void Link_graph_processor::add_link(const Url_t& from_url, const Url_t& to_url) {
+    Thread_edges& thread_edges = edges_.local();
+    size_t old_capacity = thread_edges.edges.capacity();
+    thread_edges.edges.emplace_back(page_id(page_key(from_url), from_url), 
+        page_id(page_key(to_url), to_url));
+    charge_edges(thread_edges, old_capacity);
+}
+
+void Link_graph_processor::process_page_content(const Url_t& page_url,
+    const Url_t& site_domain, int http_code, int depth,
+    const Page_paths_t& page_paths, const Page_content_t& page_content) {
+    Page_id_t from_id = page_id(page_key(page_url), page_url);
+    Thread_edges& thread_edges = edges_.local();
+    size_t old_capacity = thread_edges.edges.capacity();
+    for (const Page_path_t& page_path: page_paths) {
+        thread_edges.edges.emplace_back(from_id, page_id(page_key(site_domain, page_path),
+            Url_mgr::make_full_url(site_domain, page_path)));
+    }
+    charge_edges(thread_edges, old_capacity);
+}
+
+// Splits [0, num_items) into num_ranges() ranges and runs fcn(begin, end, range_index)
+// on each range in the thread pool. A multi-step computation runs all its steps in
+// one call, with a std::barrier between them, so the threads are only started once.
+template <class Fcn_t>
+void Link_graph_processor::run_in_parallel(size_t num_items, Fcn_t fcn) {
+    struct Range_ftor {
+        Fcn_t* fcn_ptr;
+        size_t begin, end, index;
+        bool operator() () {
+            (*fcn_ptr)(begin, end, index);
+            return false;
+        }
+    };
+    size_t range_count = num_ranges(num_items);
+    size_t range_size = (num_items + range_count - 1) / range_count;
+    std::vector<Range_ftor> ranges;
+    for (size_t i = 0; i < range_count; ++i) {
+        size_t begin = std::min(i * range_size, num_items);
+        ranges.push_back(Range_ftor{&fcn, begin, std::min(begin + range_size, num_items), i});
+    }
+    thread_pool_.run(ranges.begin(), ranges.end());
+}
+
+static Csr_graph make_csr(size_t num_nodes, const std::vector<std::pair<Page_id_t, Page_id_t>>& edges,
+    bool reversed) {
+    Csr_graph graph;
+    graph.offsets.assign(num_nodes + 1, 0);
+    for (const auto& [from, to]: edges) {
+        ++graph.offsets[(reversed ? to : from) + 1];
+    }
+    std::partial_sum(graph.offsets.begin(), graph.offsets.end(), graph.offsets.begin());
+    graph.targets.resize(edges.size());
+    std::vector<uint64_t> fill_pos(graph.offsets.begin(), graph.offsets.end() - 1);
+    for (const auto& [from, to]: edges) {
+        graph.targets[fill_pos[reversed ? to : from]++] = reversed ? from : to;
+    }
+    return graph;
+}
+
+void Link_graph_processor::build_graphs() {
+    size_t num_nodes = next_id_;
+    urls_.resize(num_nodes);
+    url_ids_.reserve(num_nodes);
+    for (Id_shard& shard: id_shards_) {
+        for (auto& [id, url]: shard.urls) {
+            urls_[id] = std::move(url);
+        }
+        std::vector<std::pair<Page_id_t, Url_t>>().swap(shard.urls);
+        url_ids_.merge(shard.ids);
+        shard.ids.clear();
+    }
+
+    std::vector<Edge_t> edges;
+    edges_.for_each([&edges](Thread_edges& thread_edges) {
+        for (const Edge_t& edge: thread_edges.edges) {
+            if (edge.first != edge.second) {  // Self links don't count
+                edges.push_back(edge);
+            }
+        }
+        std::vector<Edge_t>().swap(thread_edges.edges);
+        thread_edges.charge.reset();
+    });
+    Csr_graph graph = make_csr(num_nodes, edges, false);
+    std::vector<Edge_t>().swap(edges);
+
+    // A page can link to the same page many times. Only count it once.
+    std::vector<uint64_t> unique_degrees(num_nodes, 0);
+    out_links_.offsets.assign(num_nodes + 1, 0);
+    // Sizes the out-links from the unique degrees, between the two steps
+    auto size_out_links = [&]() noexcept {
+        std::partial_sum(unique_degrees.begin(), unique_degrees.end(), 
+            out_links_.offsets.begin() + 1);
+        out_links_.targets.resize(out_links_.offsets.back());
+    };
+    std::barrier step_barrier(num_ranges(num_nodes), size_out_links);
+    run_in_parallel(num_nodes, [&](size_t begin, size_t end, size_t) {
+        for (size_t node = begin; node < end; ++node) {
+            auto row_begin = graph.targets.begin() + graph.offsets[node];
+            auto row_end = graph.targets.begin() + graph.offsets[node + 1];
+            std::sort(row_begin, row_end);
+            unique_degrees[node] = std::unique(row_begin, row_end) - row_begin;
+        }
+        step_barrier.arrive_and_wait();
+        for (size_t node = begin; node < end; ++node) {
+            std::copy_n(graph.targets.begin() + graph.offsets[node], unique_degrees[node],
+                out_links_.targets.begin() + out_links_.offsets[node]);
+        }
+    });
+
+    edges.reserve(out_links_.targets.size());
+    for (Page_id_t node = 0; node < num_nodes; ++node) {
+        for (uint64_t pos = out_links_.offsets[node]; pos < out_links_.offsets[node + 1]; ++pos) {
+            edges.emplace_back(node, out_links_.targets[pos]);
+        }
+    }
+    in_links_ = make_csr(num_nodes, edges, true);
+}
+
+// Pull-based power iteration over the in-links, so each thread only writes
+// the ranks of its own range of pages
+void Link_graph_processor::compute_page_ranks() {
+    size_t num_nodes = urls_.size();
+    if (num_nodes == 0) return;
+    const double initial_rank = 1.0 / num_nodes;
+    const double tolerance = 1e-9;
+    ranks_.assign(num_nodes, initial_rank);
+    std::vector<double> new_ranks(num_nodes), contributions(num_nodes);
+    std::vector<double> range_sums(num_ranges(num_nodes));
+    double base_rank = 0.0;
+    int iteration = 0;
+    bool is_done = max_iterations_ <= 0;
+    bool is_rank_step = false;
+    // Runs in one thread between the steps, after every range's sum is in
+    auto end_step = [&]() noexcept {
+        double sum = std::accumulate(range_sums.begin(), range_sums.end(), 0.0);
+        if (!is_rank_step) {
+            // Pages without links spread their rank evenly over every page
+            base_rank = (1.0 - damping_ + damping_ * sum) / num_nodes;
+        }
+        else {
+            ranks_.swap(new_ranks);
+            is_done = sum < tolerance or ++iteration >= max_iterations_;
+        }
+        is_rank_step = !is_rank_step;
+    };
+    std::barrier step_barrier(range_sums.size(), end_step);
+    run_in_parallel(num_nodes, [&](size_t begin, size_t end, size_t index) {
+        while (!is_done) {
+            double range_dangling_rank = 0.0;
+            for (size_t node = begin; node < end; ++node) {
+                size_t degree = out_links_.degree(node);
+                contributions[node] = degree ? ranks_[node] / degree : 0.0;
+                range_dangling_rank += degree ? 0.0 : ranks_[node];
+            }
+            range_sums[index] = range_dangling_rank;
+            step_barrier.arrive_and_wait();
+
+            double range_change = 0.0;
+            for (size_t node = begin; node < end; ++node) {
+                double sum = 0.0;
+                for (uint64_t pos = in_links_.offsets[node]; pos < in_links_.offsets[node + 1]; ++pos) {
+                    sum += contributions[in_links_.targets[pos]];
+                }
+                new_ranks[node] = base_rank + damping_ * sum;
+                range_change += std::fabs(new_ranks[node] - ranks_[node]);
+            }
+            range_sums[index] = range_change;
+            step_barrier.arrive_and_wait();
+        }
+    });
+}
+
+void Link_graph_processor::final() {
+    build_graphs();
+    compute_page_ranks();
+}
+
+std::vector<Page_id_t> Link_graph_processor::top_pages(size_t count) const {
+    std::vector<Page_id_t> ids(urls_.size());
+    std::iota(ids.begin(), ids.end(), 0);
+    count = std::min(count, ids.size());
+    std::partial_sort(ids.begin(), ids.begin() + count, ids.end(),
+        [this](Page_id_t a, Page_id_t b) { return ranks_[a] > ranks_[b]; });
+    ids.resize(count);
+    return ids;
+}
@@ -0,0 +1,141 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <unordered_map>
+#include <string_view>
+#include <cstdint>
+#include <per_thread.h>
+#include <thread_pool.h>
+#include <web_common.h>
+#include <web_crawler.h>
+#include <url_canon.h>
+
+using Page_id_t = uint32_t;
+
+/// @brief Compressed sparse row graph. The edges of node n are
+/// targets[offsets[n]] to targets[offsets[n+1]-1].
+struct Csr_graph {
+    std::vector<uint64_t> offsets;
+    std::vector<Page_id_t> targets;
+
+    size_t num_nodes() const {
+        return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+    size_t degree(Page_id_t node) const {
+        return offsets[node + 1] - offsets[node];
+    }
+};
+
+/// @brief Page processor that builds the site's link graph and ranks its pages.
+/// Pages get dense integer ids as they are seen, either crawled or linked to.
+/// Every variant of a page, e.g. /docs/ and /docs/index.html, is one page,
+/// named by the first variant seen.
+/// Each thread accumulates its own edges. final() builds the graph in CSR form
+/// and computes in-degrees and PageRank in parallel.
+class Link_graph_processor : public Page_content_processor {
+public:
+    /// @param num_threads [in] Threads used for the PageRank computation
+    /// @param canon_rules [in] The crawl's rules, which decide the variants of a page
+    /// @param damping [in] PageRank damping factor
+    /// @param max_iterations [in] Maximum PageRank iterations
+    Link_graph_processor(int num_threads, const Url_canon_rules& canon_rules = Url_canon_rules{},
+        double damping = 0.85, int max_iterations = 50);
+
+    unsigned needs() const override {
+        return processor_needs_links;
+    }
+    void process_page_content(const Url_t& page_url,
+        const Url_t& site_domain, int http_code, int depth,
+        const Page_paths_t& page_paths, const Page_content_t& page_content) override;
+    void final() override;
+
+    /// @brief Adds a link between two pages. Strings that aren't URLs name pages as is.
+    /// This method can be called concurrently by multiple threads.
+    void add_link(const Url_t& from_url, const Url_t& to_url);
+
+    // The methods below are valid after final()
+    size_t num_pages() const {
+        return urls_.size();
+    }
+    size_t num_links() const {
+        return out_links_.targets.size();
+    }
+    const Url_t& url(Page_id_t id) const {
+        return urls_[id];
+    }
+    /// @brief The id of the page, found by any of its variants
+    std::optional<Page_id_t> find_id(const Url_t& url) const;
+    uint32_t in_degree(Page_id_t id) const {
+        return static_cast<uint32_t>(in_links_.degree(id));
+    }
+    uint32_t out_degree(Page_id_t id) const {
+        return static_cast<uint32_t>(out_links_.degree(id));
+    }
+    double page_rank(Page_id_t id) const {
+        return ranks_[id];
+    }
+    /// @brief The ids of the highest ranked pages, highest first
+    std::vector<Page_id_t> top_pages(size_t count) const;
+
+private:
+    enum { num_id_shards = 64 };
+    using Edge_t = std::pair<Page_id_t, Page_id_t>;
+    struct Thread_edges {
+        std::vector<Edge_t> edges;
+        std::optional<Memory_charge> charge;
+    };
+    struct Id_shard {
+        std::mutex mutex;
+        // Keyed by page_key()
+        std::unordered_map<Url_t, Page_id_t> ids;
+        // The first URL seen for each new id
+        std::vector<std::pair<Page_id_t, Url_t>> urls;
+    };
+
+    const int num_threads_;
+    const Url_canonicalizer canon_;
+    const double damping_;
+    const int max_iterations_;
+    std::atomic<Page_id_t> next_id_{0};
+    std::array<Id_shard, num_id_shards> id_shards_;
+    Per_thread<Thread_edges> edges_;
+    std::vector<Url_t> urls_;
+    std::unordered_map<Url_t, Page_id_t> url_ids_;
+    // Runs the graph building and the PageRank iterations, each in one set of threads
+    Thread_pool thread_pool_;
+    Csr_graph out_links_;
+    Csr_graph in_links_;
+    std::vector<double> ranks_;
+
+    Page_id_t page_id(const Url_t& key, const Url_t& url);
+    Url_t page_key(const Url_t& site_domain, const Page_path_t& page_path) const;
+    Url_t page_key(const Url_t& url) const;
+    void charge_edges(Thread_edges& thread_edges, size_t old_capacity);
+    Id_shard& id_shard(const Url_t& url) {
+        return id_shards_[std::hash<Url_t>{}(url) % num_id_shards];
+    }
+    void build_graphs();
+    void compute_page_ranks();
+    size_t num_ranges(size_t num_items) const {
+        return std::min<size_t>(num_threads_, std::max<size_t>(num_items, 1));
+    }
+    template <class Fcn_t>
+    void run_in_parallel(size_t num_items, Fcn_t fcn);
+};
@@ -11,85 +11,388 @@ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR I
  ***/
 
 #include <iostream>
-#include <unordered_map>
-#include <mutex>
 #include <thread>
+#include <string>
+#include <sstream>
+#include <optional>
+#include <chrono>
 #include <url_mgr.h>
 #include <web_crawler.h>
+#include <page_archive.h>
+#include <link_graph.h>
+#include <page_capture.h>
+#include <site_stats.h>
 
 
-class Example_content_processor : public Page_content_processor {
+// Passes each page on to every processor in the chain
+class Content_processor_chain : public Page_content_processor {
 public:
+    void add(Page_content_processor* processor_ptr) {
+        processors_.push_back(processor_ptr);
+    }
+    unsigned needs() const override {
+        unsigned needs = processor_needs_headers;
+        for (Page_content_processor* processor_ptr: processors_) {
+            needs |= processor_ptr->needs();
+        }
+        return needs;
+    }
+    void process_body_chunk(const Url_t& page_url, size_t offset,
+        Page_content_t chunk) override {
+        for (Page_content_processor* processor_ptr: processors_) {
+            if (processor_ptr->needs() & processor_needs_body_stream) {
+                processor_ptr->process_body_chunk(page_url, offset, chunk);
+            }
+        }
+    }
+    void process_response_headers(const Url_t& page_url, std::string_view headers) override {
+        for (Page_content_processor* processor_ptr: processors_) {
+            if (processor_ptr->needs() & processor_needs_response_headers) {
+                processor_ptr->process_response_headers(page_url, headers);
+            }
+        }
+    }
     void process_page_content(const Url_t& page_url, 
         const Url_t& site_domain, int http_code, int depth,
-        const Page_paths_t& page_links, const Page_content_t& page_content) override;
+        const Page_paths_t& page_links, const Page_content_t& page_content) override {
+        for (Page_content_processor* processor_ptr: processors_) {
+            processor_ptr->process_page_content(page_url, site_domain, http_code,
+                depth, page_links, page_content);
+        }
+    }
     void final() override {
-        is_done_ = true;
-        std::cout << "Done processing the site's pages" << std::endl;
+        for (Page_content_processor* processor_ptr: processors_) {
+            processor_ptr->final();
+        }
+    }
+    void set_memory_accountant(Memory_accountant* memory_ptr) override {
+        for (Page_content_processor* processor_ptr: processors_) {
+            processor_ptr->set_memory_accountant(memory_ptr);
+        }
     }
-    void print_site_info();
-
 private:
-    struct Page_info {
-        int http_code;
-        size_t size;
-        int depth;
-        int num_links;
-        int num_backlinks;
-    };
-    bool is_done_{false};
-    std::mutex proc_mutex_;
-    using Page_info_map = std::unordered_map<Url_t, Page_info>;
-    Page_info_map page_info_map_;
+    std::vector<Page_content_processor*> processors_;
 };
 
-void Example_content_processor::process_page_content(const Url_t& page_url, 
-    const Url_t& site_domain, int http_code, int depth,
-    const Page_paths_t& page_links, const Page_content_t& page_content) {
-    std::lock_guard lock(proc_mutex_);
-    std::cout << "Process page_content for: " << page_url <<
-        " HTTP code " << http_code <<
-        " has " << page_content.size() << " bytes" <<
-        " and has " << page_links.size() << " links " << std::endl;
-    page_info_map_.emplace(page_url, 
-        Page_info{http_code, page_content.size(), depth, 
-            static_cast<int>(page_links.size()), 1});
-    for (auto page_link: page_links) {
-        Url_t full_url = Url_mgr::make_full_url(site_domain, 
-            page_link.path, page_link.page);
-        auto iter = page_info_map_.find(full_url);
-        if (iter != page_info_map_.end()) {
-            ++iter->second.num_backlinks;
-        }
+struct Crawler_options {
+    Url_t site_url;
+    int num_threads;
+    int max_depth{Web_crawler::unlimited_depth};
+    int node_id{0};
+    Cluster_node_addrs_t cluster_nodes;
+    std::string archive_dir;
+    bool archive_compress{false};
+    size_t num_top_pages{0};
+    Frontier_config frontier_config;
+    Url_canon_rules canon_rules;
+    Url_rules_config url_rules;
+    Host_health_config host_health_config;
+    Crawl_budget budget;
+    std::string trace_file;
+    size_t memory_budget{0};
+    std::string seed_file;
+    bool recrawl{false};
+    Revisit_config revisit_config;
+    std::string record_file;
+    std::string replay_file;
+    Thread_placement placement;
+};
+
+const char* stop_reason_text(Crawl_stop_reason reason) {
+    switch (reason) {
+        case crawl_stop_page_limit: return "page limit reached";
+        case crawl_stop_byte_limit: return "byte limit reached";
+        case crawl_stop_deadline: return "time limit reached";
+        case crawl_stop_cancelled: return "cancelled";
+        default: return "completed";
     }
 }
 
-void Example_content_processor::print_site_info() {
-    if (!is_done_) {
-        std::cout << "Site crawling is still in progress..." << std::endl;
-        return;
-    }
-    for (auto info: page_info_map_) {
-        std::cout << "Page: " << info.first <<
-            ", code: " << info.second.http_code <<
-            ", size: " << info.second.size <<
-            ", depth: " << info.second.depth <<
-            ", links: " << info.second.num_links <<
-            ", backlinks: " << info.second.num_backlinks << std::endl;
+void print_top_pages(const Link_graph_processor& link_graph, size_t num_pages) {
+    std::cout << "Top " << num_pages << " of " << link_graph.num_pages() << 
+        " pages by PageRank" << std::endl;
+    for (Page_id_t id: link_graph.top_pages(num_pages)) {
+        std::cout << "Page: " << link_graph.url(id) <<
+            ", rank: " << link_graph.page_rank(id) <<
+            ", links: " << link_graph.out_degree(id) <<
+            ", backlinks: " << link_graph.in_degree(id) << std::endl;
     }
 }
 
-bool perform_crawler_test(const Url_t& site_url, int num_threads, int max_depth) {
-    std::cout << "Peform web crawler test for: " << site_url << std::endl;
-    Example_content_processor cp;
-    Web_crawler web_crawler(num_threads, max_depth);
-    Crawl_result_t result = web_crawler.crawl(site_url, &cp);
+// Runs the crawl with the options shared by every reader
+template <class Crawler_t>
+bool crawl_site(Crawler_t& web_crawler, const Crawler_options& options,
+    Page_content_processor* processor_ptr) {
+    web_crawler.set_frontier_config(options.frontier_config);
+    web_crawler.set_canon_rules(options.canon_rules);
+    web_crawler.set_url_rules(options.url_rules);
+    web_crawler.set_host_health_config(options.host_health_config);
+    web_crawler.set_thread_placement(options.placement);
+    web_crawler.set_budget(options.budget);
+    web_crawler.set_memory_budget(options.memory_budget);
+    web_crawler.set_seed_file(options.seed_file);
+    std::optional<Revisit_scheduler> revisit_scheduler;
+    if (options.recrawl) {
+        revisit_scheduler.emplace(options.revisit_config);
+        web_crawler.set_revisit_scheduler(&*revisit_scheduler);
+    }
+    std::optional<Crawl_cluster_node> cluster_node;
+    if (!options.cluster_nodes.empty()) {
+        cluster_node.emplace(options.node_id, options.cluster_nodes, options.canon_rules);
+        if (!cluster_node->start()) {
+            return false;
+        }
+        web_crawler.set_cluster_node(&*cluster_node);
+    }
+    if (!options.trace_file.empty()) {
+        Tracer::global().enable();
+    }
+    auto start_time = std::chrono::steady_clock::now();
+    Crawl_result_t result = web_crawler.crawl(options.site_url, processor_ptr);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    if (!options.trace_file.empty()) {
+        Tracer::global().disable();
+        if (Tracer::global().write_chrome_json(options.trace_file)) {
+            std::cout << "Wrote " << Tracer::global().num_events() << " trace events to " << 
+                options.trace_file << std::endl;
+        }
+        else {
+            std::cout << "trace error: writing " << options.trace_file << std::endl;
+        }
+    }
     if (!result) {
         std::cout << "Error crawling website: " << result.error().err_text << std::endl;
         return false;
     }
+    if (web_crawler.num_unpinned_threads() > 0) {
+        std::cout << "pin error: " << web_crawler.num_unpinned_threads() << 
+            " threads couldn't be pinned to their CPUs and ran unpinned" << std::endl;
+    }
+    if (!options.seed_file.empty()) {
+        const Seed_load_stats& seed_stats = web_crawler.seed_stats();
+        std::cout << "Loaded " << seed_stats.num_seeds << " seeds from " << 
+            seed_stats.num_urls << " URLs in " << seed_stats.load_time.count() << " ms, " <<
+            seed_stats.num_rejected << " rejected, " << seed_stats.num_duplicates << 
+            " duplicates" << std::endl;
+    }
+    Transfer_stats stats = web_crawler.transfer_stats();
+    std::cout << "Transferred " << stats.wire_bytes << " bytes on the wire for " <<
+        stats.decoded_bytes << " decoded bytes" << std::endl;
+    std::cout << "Aborted " << stats.num_aborted_reads << " non-HTML or oversized reads, avoiding " <<
+        stats.avoided_bytes << " bytes" << std::endl;
+    for (const Host_latency_stats& host_stats: web_crawler.host_stats()) {
+        std::cout << "Host: " << host_stats.host << 
+            ", requests: " << host_stats.num_requests <<
+            ", failures: " << host_stats.num_failures <<
+            ", breaker trips: " << host_stats.num_breaker_trips <<
+            ", p50: " << host_stats.p50_ms << " ms" <<
+            ", p99: " << host_stats.p99_ms << " ms" <<
+            ", deadline: " << host_stats.deadline_ms << " ms" << std::endl;
+    }
+    Memory_stats memory_stats = web_crawler.memory_stats();
+    std::cout << "Memory peaked at " << memory_stats.peak_bytes << " bytes";
+    if (memory_stats.budget_bytes > 0) {
+        std::cout << " of the " << memory_stats.budget_bytes << " byte budget, " <<
+            memory_stats.num_paused_fetches << " fetches paused for memory";
+    }
+    std::cout << std::endl;
+    if (revisit_scheduler) {
+        Revisit_stats revisit_stats = revisit_scheduler->stats();
+        std::cout << "Revisit schedule of " << revisit_stats.num_pages << " pages: " << 
+            revisit_stats.num_visits << " visits, " << revisit_stats.num_changed << 
+            " changed, " << revisit_stats.num_unchanged << " unchanged" << std::endl;
+    }
+    std::cout << "Crawl " << stop_reason_text(web_crawler.stop_reason()) << 
+        ", crawled in " << elapsed.count() << " seconds" << std::endl;
+    return true;
+}
+
+bool perform_crawler_test(const Crawler_options& options) {
+    std::cout << "Peform web crawler test for: " << options.site_url << std::endl;
+    // Report bad patterns before crawling without them
+    if (!Url_rules(options.url_rules).is_valid()) {
+        return false;
+    }
+    Site_stats_processor site_stats(&std::cout);
+    Content_processor_chain processors;
+    processors.add(&site_stats);
+    std::optional<Page_archive_processor> archive;
+    if (!options.archive_dir.empty()) {
+        archive.emplace(Page_archive_config{options.archive_dir, "crawl", 
+            1024ULL * 1024 * 1024, options.archive_compress});
+        if (!archive->open()) {
+            return false;
+        }
+        processors.add(&*archive);
+    }
+    std::optional<Link_graph_processor> link_graph;
+    if (options.num_top_pages > 0) {
+        link_graph.emplace(std::thread::hardware_concurrency(), options.canon_rules);
+        processors.add(&*link_graph);
+    }
+    bool crawled;
+    if (!options.replay_file.empty()) {
+        // Replays serve the pages from memory, so the crawl runs at CPU speed
+        Basic_web_crawler<Replay_page_reader> web_crawler(options.num_threads, options.max_depth);
+        if (!web_crawler.reader().open(options.replay_file)) {
+            return false;
+        }
+        crawled = crawl_site(web_crawler, options, &processors);
+    }
+    else {
+        Page_capture_writer capture;
+        if (!options.record_file.empty() and !capture.open(options.record_file)) {
+            return false;
+        }
+        Web_crawler web_crawler(options.num_threads, options.max_depth, 
+            options.record_file.empty() ? nullptr : &capture);
+        crawled = crawl_site(web_crawler, options, &processors);
+        if (!options.record_file.empty()) {
+            capture.close();
+            std::cout << "Recorded " << capture.num_records() << " pages to " << 
+                options.record_file << std::endl;
+        }
+    }
+    if (crawled) {
+        site_stats.print_site_info(std::cout);
+        if (archive) {
+            std::cout << "Archived " << archive->num_records() << " pages in " <<
+                archive->bytes_written() << " bytes across " << 
+                archive->num_segments() << " segments" << std::endl;
+        }
+        if (link_graph) {
+            print_top_pages(*link_graph, options.num_top_pages);
+        }
+    }
+    return crawled;
+}
+
+// Parses a comma separated list of host:port node addresses
+Cluster_node_addrs_t parse_cluster_nodes(const std::string& nodes_arg) {
+    Cluster_node_addrs_t nodes;
+    std::istringstream nodes_stream(nodes_arg);
+    std::string node;
+    while (std::getline(nodes_stream, node, ',')) {
+        size_t colon_pos = node.rfind(':');
+        if (colon_pos != std::string::npos) {
+            nodes.push_back(Cluster_node_addr{node.substr(0, colon_pos), 
+                std::stoi(node.substr(colon_pos + 1))});
+        }
+    }
+    return nodes;
+}
+
+// Options are --NAME=VALUE, or --NAME for flags
+bool parse_option(const std::string& arg, Crawler_options& options) {
+    if (arg.rfind("--", 0) != 0) {
+        return false;
+    }
+    size_t eq_pos = arg.find('=');
+    std::string name = arg.substr(2, eq_pos == std::string::npos ? 
+        std::string::npos : eq_pos - 2);
+    std::string value = eq_pos == std::string::npos ? "" : arg.substr(eq_pos + 1);
+    if (name == "node") {
+        options.node_id = std::stoi(value);
+    }
+    else if (name == "cluster") {
+        options.cluster_nodes = parse_cluster_nodes(value);
+    }
+    else if (name == "archive") {
+        options.archive_dir = value;
+    }
+    else if (name == "archive-gzip") {
+        options.archive_compress = true;
+    }
+    else if (name == "top-pages") {
+        options.num_top_pages = std::stoul(value);
+    }
+    else if (name == "frontier-mb") {
+        options.frontier_config.memory_budget_bytes = std::stoul(value) * 1024 * 1024;
+    }
+    else if (name == "spill-dir") {
+        options.frontier_config.spill_dir = value;
+    }
+    else if (name == "pin") {
+        if (value == "compact") {
+            options.placement.policy = placement_compact;
+        }
+        else if (value == "scatter") {
+            options.placement.policy = placement_scatter;
+        }
+        else {
+            options.placement.policy = placement_explicit;
+            options.placement.cpus = Cpu_topology::parse_cpu_list(value);
+        }
+    }
+    else if (name == "record") {
+        options.record_file = value;
+    }
+    else if (name == "replay") {
+        options.replay_file = value;
+    }
+    else if (name == "retries") {
+        options.host_health_config.max_retries = std::stoi(value);
+    }
+    else if (name == "max-deadline-ms") {
+        options.host_health_config.max_deadline_ms = std::stol(value);
+    }
+    else if (name == "seeds") {
+        options.seed_file = value;
+    }
+    else if (name == "memory-mb") {
+        options.memory_budget = std::stoul(value) * 1024 * 1024;
+    }
+    else if (name == "recrawl") {
+        options.recrawl = true;
+        if (!value.empty()) {
+            options.revisit_config.initial_interval = std::chrono::seconds(std::stol(value));
+            options.revisit_config.min_interval = std::min(
+                options.revisit_config.min_interval, options.revisit_config.initial_interval);
+        }
+    }
+    else if (name == "trace") {
+        options.trace_file = value;
+    }
+    else if (name == "max-pages") {
+        options.budget.max_pages = std::stoul(value);
+    }
+    else if (name == "max-mb") {
+        options.budget.max_bytes = std::stoul(value) * 1024 * 1024;
+    }
+    else if (name == "max-seconds") {
+        options.budget.max_duration = std::chrono::seconds(std::stol(value));
+    }
+    else if (name == "include") {
+        options.url_rules.include_patterns.push_back(value);
+    }
+    else if (name == "exclude") {
+        options.url_rules.exclude_patterns.push_back(value);
+    }
+    else if (name == "max-path-depth") {
+        options.url_rules.max_path_depth = std::stoi(value);
+    }
+    else if (name == "max-query-params") {
+        options.url_rules.max_query_params = std::stoi(value);
+    }
+    else if (name == "query") {
+        // strip, keep, or the list of parameters to keep
+        if (value == "strip") {
+            options.canon_rules.query_mode = query_strip_all;
+        }
+        else if (value == "keep") {
+            options.canon_rules.query_mode = query_keep_all;
+        }
+        else {
+            options.canon_rules.query_mode = query_whitelist;
+            std::stringstream ss(value);
+            std::string param;
+            while (std::getline(ss, param, ',')) {
+                options.canon_rules.whitelist_params.push_back(param);
+            }
+        }
+    }
     else {
-        cp.print_site_info();
+        return false;
     }
     return true;
 }
@@ -97,10 +400,44 @@ bool perform_crawler_test(const Url_t& site_url, int num_threads, int max_depth)
 void usage() {
     std::cout << "Multi-threaded crawler that crawls and processes the pages on the " << 
         "specified site and its children.\n"  << std::endl;
-    std::cout << "Usage: web-crawler SITE_URL NUM_THREADS [MAX_DEPTH]"  << std::endl;
+    std::cout << "Usage: web-crawler SITE_URL NUM_THREADS [MAX_DEPTH] [OPTIONS]"  << std::endl;
     std::cout << "E.g.:  web-crawler \"https://gcc.gnu.org/install/\" 5 3\n"  << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --cluster=HOST:PORT,...  Distributed crawl across the listed nodes" << std::endl;
+    std::cout << "  --node=ID                This node's index in the cluster list (default 0)" << std::endl;
+    std::cout << "  --archive=DIR            Append the pages to WARC segment files in DIR" << std::endl;
+    std::cout << "  --archive-gzip           Gzip the archived records" << std::endl;
+    std::cout << "  --top-pages=N            Rank the site's pages and list the top N" << std::endl;
+    std::cout << "  --frontier-mb=MB         Memory for pending URLs, the rest spill to disk" << std::endl;
+    std::cout << "  --spill-dir=DIR          Directory for the spilled URLs (default: temp dir)" << std::endl;
+    std::cout << "  --pin=POLICY             Pin the threads: compact fills a socket first," << std::endl;
+    std::cout << "                           scatter spreads them, or a CPU list like 0-3,8" << std::endl;
+    std::cout << "  --record=FILE            Save every page read to a capture file" << std::endl;
+    std::cout << "  --replay=FILE            Crawl the pages in a capture file instead of the site" << std::endl;
+    std::cout << "  --retries=N              Retries of timed out and failed pages (default 2)" << std::endl;
+    std::cout << "  --max-deadline-ms=MS     Longest request deadline, shorter ones adapt to" << std::endl;
+    std::cout << "                           the host's p99 latency (default 20000)" << std::endl;
+    std::cout << "  --query=strip|keep|P,... Query parameters to crawl: none, all but tracking" << std::endl;
+    std::cout << "                           ones (default), or only the listed ones" << std::endl;
+    std::cout << "  --include=PATTERN        Only crawl the URLs that match a pattern. Globs like" << std::endl;
+    std::cout << "                           /docs/** or regexes like re:^/blog/[0-9]+$" << std::endl;
+    std::cout << "  --exclude=PATTERN        Don't crawl the URLs that match the pattern" << std::endl;
+    std::cout << "  --max-path-depth=N       Don't crawl URLs with more than N directories" << std::endl;
+    std::cout << "  --max-query-params=N     Don't crawl URLs with more than N query parameters" << std::endl;
+    std::cout << "  --max-pages=N            Stop after reading N pages" << std::endl;
+    std::cout << "  --max-mb=MB              Stop after reading MB of page content" << std::endl;
+    std::cout << "  --max-seconds=S          Stop after S seconds" << std::endl;
+    std::cout << "  --seeds=FILE             Also start from the site's URLs in FILE, one per line" << std::endl;
+    std::cout << "  --memory-mb=MB           Memory for the pages being read and processed." << std::endl;
+    std::cout << "                           Reads wait when it runs out" << std::endl;
+    std::cout << "  --recrawl[=S]            Keep crawling, revisiting each page as often as" << std::endl;
+    std::cout << "                           it changes. First revisit after S seconds (600)." << std::endl;
+    std::cout << "                           Stop it with a budget like --max-seconds" << std::endl;
+    std::cout << "  --trace=FILE             Write a timeline of the crawl's phases as Chrome" << std::endl;
+    std::cout << "                           trace JSON, viewable in ui.perfetto.dev\n" << std::endl;
     std::cout << "This platform supports " << 
         std::thread::hardware_concurrency() << " concurrent threads" << std::endl;
+    std::cout << "CPU topology: " << Cpu_topology::detect().summary() << std::endl;
     std::cout << "See: include/thread_pool.h for the thread management\n"  << std::endl;
 }
 
@@ -111,10 +448,28 @@ int main(int argc, char *argv[]) {
     }
     // In production code, do more error checking on the command line args. 
     // But, this is a demo project.
-    const char* site_url = argv[1];
-    const int num_threads = std::stoi(argv[2]);
-    const int max_depth = argc >= 4 ? std::stoi(argv[3])
-        : Web_crawler::unlimited_depth;
-    return perform_crawler_test(site_url, num_threads, max_depth) ? 0 : 1;
+    Crawler_options options;
+    options.site_url = argv[1];
+    options.num_threads = std::stoi(argv[2]);
+    int arg_index = 3;
+    if (argc > arg_index and std::string(argv[arg_index]).rfind("--", 0) != 0) {
+        options.max_depth = std::stoi(argv[arg_index++]);
+    }
+    for (; arg_index < argc; ++arg_index) {
+        if (!parse_option(argv[arg_index], options)) {
+            std::cout << "Unknown option: " << argv[arg_index] << std::endl;
+            usage();
+            return 1;
+        }
+    }
+    // --node and --cluster can come in either order
+    if (!options.cluster_nodes.empty() and (options.node_id < 0 or 
+        options.node_id >= static_cast<int>(options.cluster_nodes.size()))) {
+        std::cout << "Invalid node: " << options.node_id << ", the cluster has " << 
+            options.cluster_nodes.size() << " nodes" << std::endl;
+        usage();
+        return 1;
+    }
+    return perform_crawler_test(options) ? 0 : 1;
 }
 
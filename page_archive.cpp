@@ -0,0 +1,284 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+#include <page_archive.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <filesystem>
+#include <random>
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <zlib.h>
+}
+
+Page_archive_processor::Page_archive_processor(const Page_archive_config& config) :
+    config_(config), record_id_salt_((static_cast<uint64_t>(std::random_device{}()) << 32) ^
+        std::random_device{}()) {}
+
+Page_archive_processor::~Page_archive_processor() {
+    close_segment();
+}
+
+bool Page_archive_processor::open() {
+    std::error_code ec;
+    std::filesystem::create_directories(config_.dir, ec);
+    return open_segment();
+}
+
+uint64_t Page_archive_processor::hash_url(const Url_t& url) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c: url) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+std::string Page_archive_processor::segment_path(const char* extension) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "-%05d", segment_num_);
+    return (std::filesystem::path(config_.dir) / (config_.prefix + name + extension)).string();
+}
+
+bool Page_archive_processor::open_segment() {
+    const char* extension = config_.compress ? ".warc.gz" : ".warc";
+    segment_fd_ = ::open(segment_path(extension).c_str(),
+        O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    index_fd_ = ::open(segment_path(".idx").c_str(),
+        O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    segment_offset_ = 0;
+    if (segment_fd_ < 0 or index_fd_ < 0) {
+        std::cout << "archive error: opening segment " << segment_path(extension) << std::endl;
+        close_segment();
+        return false;
+    }
+    return true;
+}
+
+void Page_archive_processor::close_segment() {
+    if (segment_fd_ >= 0) {
+        ::close(segment_fd_);
+        segment_fd_ = -1;
+    }
+    if (index_fd_ >= 0) {
+        ::close(index_fd_);
+        index_fd_ = -1;
+    }
+}
+
+// A record that can't be compressed isn't written, since a .warc.gz segment 
+// can't hold it uncompressed
+static std::optional<std::string> gzip_record(const std::string& record) {
+    std::string compressed;
+    z_stream strm{};
+    // 16 + MAX_WBITS writes a gzip member, so records can be decompressed individually
+    if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8,
+        Z_DEFAULT_STRATEGY) != Z_OK) {
+        return std::nullopt;
+    }
+    compressed.resize(deflateBound(&strm, record.size()));
+    strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(record.data()));
+    strm.avail_in = record.size();
+    strm.next_out = reinterpret_cast<Bytef*>(compressed.data());
+    strm.avail_out = compressed.size();
+    int status = deflate(&strm, Z_FINISH);
+    compressed.resize(strm.total_out);
+    deflateEnd(&strm);
+    if (status != Z_STREAM_END) {
+        return std::nullopt;
+    }
+    return compressed;
+}
+
+static bool is_framing_header(std::string_view line) {
+    for (std::string_view name: {"content-length:", "content-encoding:", "transfer-encoding:"}) {
+        if (line.size() >= name.size() and std::equal(name.begin(), name.end(), line.begin(),
+            [](char name_c, char line_c) {
+                return name_c == std::tolower(static_cast<unsigned char>(line_c)); })) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The response's headers as received. The content is stored decoded, so the
+// headers that framed the encoded body are replaced by its Content-Length. 
+// Without headers, e.g. for replayed pages, only the status is known.
+static std::string make_http_block(int http_code, std::string_view response_headers,
+    size_t content_size) {
+    std::string http_block;
+    if (response_headers.empty()) {
+        http_block = "HTTP/1.1 " + std::to_string(http_code) + "\r\n";
+    }
+    while (!response_headers.empty()) {
+        size_t line_size = std::min(response_headers.find('\n'), response_headers.size() - 1) + 1;
+        std::string_view line = response_headers.substr(0, line_size);
+        response_headers.remove_prefix(line_size);
+        if (line == "\r\n" or line == "\n") break;
+        if (!is_framing_header(line)) {
+            http_block.append(line);
+        }
+    }
+    return http_block.append("Content-Length: " + std::to_string(content_size) + "\r\n\r\n");
+}
+
+void Page_archive_processor::process_response_headers(const Url_t& page_url,
+    std::string_view headers) {
+    batches_.local().response_headers.assign(headers);
+}
+
+std::string Page_archive_processor::format_record(const Url_t& page_url, int http_code,
+    int depth, std::string_view response_headers, const Page_content_t& page_content) {
+    std::string http_block = make_http_block(http_code, response_headers, page_content.size());
+    char date[32];
+    std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    std::tm tm_now;
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&now, &tm_now));
+    // The date only has second resolution, so the low half of the id is a
+    // sequence number rather than anything derived from the page
+    uint64_t id_hash = hash_url(page_url + date);
+    uint64_t id_seq = record_id_salt_ + next_record_seq_++;
+    char record_id[64];
+    std::snprintf(record_id, sizeof(record_id), "<urn:uuid:%08x-%04x-4%03x-%04x-%012llx>",
+        static_cast<unsigned>(id_hash >> 32), static_cast<unsigned>(id_hash >> 16) & 0xffff,
+        static_cast<unsigned>(id_hash) & 0xfff,
+        0x8000 | (static_cast<unsigned>(id_seq >> 48) & 0x3fff),
+        static_cast<unsigned long long>(id_seq) & 0xffffffffffffULL);
+
+    std::string record;
+    record.reserve(512 + page_url.size() + http_block.size() + page_content.size());
+    record.append("WARC/1.0\r\n"
+        "WARC-Type: response\r\n"
+        "WARC-Target-URI: ").append(page_url).append("\r\n"
+        "WARC-Date: ").append(date).append("\r\n"
+        "WARC-Record-ID: ").append(record_id).append("\r\n"
+        "WARC-X-Crawl-Depth: ").append(std::to_string(depth)).append("\r\n"
+        "Content-Type: application/http; msgtype=response\r\n"
+        "Content-Length: ").append(std::to_string(http_block.size() + page_content.size()))
+        .append("\r\n\r\n");
+    record.append(http_block);
+    record.append(page_content.data(), page_content.size());
+    record.append("\r\n\r\n");
+    return record;
+}
+
+void Page_archive_processor::process_page_content(const Url_t& page_url,
+    const Url_t& site_domain, int http_code, int depth,
+    const Page_paths_t& page_paths, const Page_content_t& page_content) {
+    // Each thread gets its own batch, so building records needs no locking
+    Thread_batch& batch = batches_.local();
+    std::string record = format_record(page_url, http_code, depth, batch.response_headers,
+        page_content);
+    batch.response_headers.clear();
+    if (config_.compress) {
+        std::optional<std::string> compressed = gzip_record(record);
+        if (!compressed) {
+            std::cout << "archive error: compressing the record for " << page_url << std::endl;
+            return;
+        }
+        record = std::move(*compressed);
+    }
+    batch.records.push_back(std::move(record));
+    // The offset is filled in when the batch is written
+    batch.index_entries.push_back(Page_archive_index_entry{hash_url(page_url), 0,
+        static_cast<uint32_t>(batch.records.back().size()), static_cast<uint32_t>(http_code)});
+    batch.num_bytes += batch.records.back().size();
+    if (batch.num_bytes >= config_.batch_bytes) {
+        write_batch(batch);
+    }
+    else {
+        charge_work(batch.charge, batch.num_bytes);
+    }
+}
+
+static bool writev_all(int fd, std::vector<iovec>& iovs) {
+    size_t iov_pos = 0;
+    while (iov_pos < iovs.size()) {
+        int iov_count = static_cast<int>(std::min<size_t>(iovs.size() - iov_pos, IOV_MAX));
+        ssize_t written = ::writev(fd, &iovs[iov_pos], iov_count);
+        if (written < 0) return false;
+        // Skip the fully written buffers and trim a partially written one
+        while (iov_pos < iovs.size() and written >= static_cast<ssize_t>(iovs[iov_pos].iov_len)) {
+            written -= iovs[iov_pos++].iov_len;
+        }
+        if (written > 0) {
+            iovs[iov_pos].iov_base = static_cast<char*>(iovs[iov_pos].iov_base) + written;
+            iovs[iov_pos].iov_len -= written;
+        }
+    }
+    return true;
+}
+
+void Page_archive_processor::write_batch(Thread_batch& batch) {
+    if (batch.records.empty()) return;
+    std::vector<iovec> record_iovs;
+    record_iovs.reserve(batch.records.size());
+    for (std::string& record: batch.records) {
+        record_iovs.push_back(iovec{record.data(), record.size()});
+    }
+    bool is_written = false;
+    {
+        std::lock_guard lock(write_mutex_);
+        if (segment_offset_ > 0 and
+            segment_offset_ + batch.num_bytes > config_.max_segment_bytes) {
+            close_segment();
+            ++segment_num_;
+            open_segment();
+        }
+        uint64_t offset = segment_offset_;
+        for (Page_archive_index_entry& entry: batch.index_entries) {
+            entry.offset = offset;
+            offset += entry.length;
+        }
+        std::vector<iovec> index_iovs{iovec{batch.index_entries.data(),
+            batch.index_entries.size() * sizeof(Page_archive_index_entry)}};
+        if (segment_fd_ >= 0 and writev_all(segment_fd_, record_iovs)) {
+            segment_offset_ = offset;
+            is_written = writev_all(index_fd_, index_iovs);
+        }
+        else if (segment_fd_ >= 0) {
+            // Part of the batch may have been written, later records go after it
+            off_t segment_end = ::lseek(segment_fd_, 0, SEEK_END);
+            if (segment_end >= 0) {
+                segment_offset_ = segment_end;
+            }
+        }
+        if (!is_written and !write_failed_.exchange(true)) {
+            std::cout << "archive error: writing segment " << segment_num_ << std::endl;
+        }
+    }
+    if (is_written) {
+        num_records_ += batch.records.size();
+        bytes_written_ += batch.num_bytes;
+    }
+    batch.records.clear();
+    batch.index_entries.clear();
+    batch.num_bytes = 0;
+    charge_work(batch.charge, 0);
+}
+
+void Page_archive_processor::final() {
+    // The crawling threads are done, so their batches can be written from here
+    batches_.for_each([this](Thread_batch& batch) {
+        write_batch(batch);
+        batch.charge.reset();
+    });
+    std::lock_guard write_lock(write_mutex_);
+    close_segment();
+}
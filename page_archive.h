@@ -0,0 +1,115 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <optional>
+#include <cstdint>
+#include <per_thread.h>
+#include <web_common.h>
+#include <web_crawler.h>
+
+struct Page_archive_config {
+    // Directory the segment and index files are written to
+    std::string dir;
+    // Segment file names are PREFIX-NNNNN.warc[.gz]
+    std::string prefix{"crawl"};
+    // A new segment is started once the current one reaches this size
+    size_t max_segment_bytes{1024ULL * 1024 * 1024};
+    // Gzip each record, like .warc.gz files
+    bool compress{false};
+    // Each thread buffers this many bytes of records before writing them
+    size_t batch_bytes{1024 * 1024};
+};
+
+// Entry in a segment's .idx file. One per record, in record order.
+struct Page_archive_index_entry {
+    uint64_t url_hash;
+    uint64_t offset;
+    uint32_t length;
+    uint32_t http_code;
+};
+
+/// @brief Page processor that appends every page to WARC-style segment files.
+/// Records are formatted, and optionally compressed, in the crawling thread and
+/// buffered per thread. A full buffer is appended to the segment with one writev,
+/// so the only lock is held for the duration of the write.
+class Page_archive_processor : public Page_content_processor {
+public:
+    Page_archive_processor(const Page_archive_config& config);
+    ~Page_archive_processor();
+
+    /// @brief Creates the archive directory and opens the first segment
+    /// @return false when the segment can't be opened
+    bool open();
+
+    unsigned needs() const override {
+        return processor_needs_body | processor_needs_response_headers;
+    }
+    /// @brief Keeps the headers for the page's record, which is built next on this thread
+    void process_response_headers(const Url_t& page_url, std::string_view headers) override;
+    void process_page_content(const Url_t& page_url,
+        const Url_t& site_domain, int http_code, int depth,
+        const Page_paths_t& page_paths, const Page_content_t& page_content) override;
+
+    /// @brief Writes the remaining buffered records and closes the segment
+    void final() override;
+
+    size_t num_records() const {
+        return num_records_;
+    }
+    size_t bytes_written() const {
+        return bytes_written_;
+    }
+    int num_segments() const {
+        return segment_num_ + 1;
+    }
+    static uint64_t hash_url(const Url_t& url);
+
+private:
+    struct Thread_batch {
+        std::vector<std::string> records;
+        std::vector<Page_archive_index_entry> index_entries;
+        size_t num_bytes{0};
+        std::optional<Memory_charge> charge;
+        // The headers of the page this thread is processing
+        std::string response_headers;
+    };
+
+    const Page_archive_config config_;
+    Per_thread<Thread_batch> batches_;
+    std::mutex write_mutex_;
+    int segment_fd_{-1};
+    int index_fd_{-1};
+    int segment_num_{0};
+    uint64_t segment_offset_{0};
+    std::atomic<size_t> num_records_{0};
+    std::atomic<size_t> bytes_written_{0};
+    std::atomic<bool> write_failed_{false};
+    // Record ids are unique within the crawl by the sequence number and
+    // across crawls by the random salt
+    const uint64_t record_id_salt_;
+    std::atomic<uint64_t> next_record_seq_{0};
+
+    std::string format_record(const Url_t& page_url, int http_code, int depth,
+        std::string_view response_headers, const Page_content_t& page_content);
+    void write_batch(Thread_batch& batch);
+    bool open_segment();
+    void close_segment();
+    std::string segment_path(const char* extension) const;
+};
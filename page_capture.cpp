@@ -0,0 +1,144 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+
+#include <page_capture.h>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+}
+
+struct Capture_record_header {
+    uint32_t url_size;
+    uint32_t http_code;
+    uint64_t wire_size;
+    uint64_t content_size;
+};
+
+Page_capture_writer::~Page_capture_writer() {
+    close();
+}
+
+bool Page_capture_writer::open(const std::string& file_path) {
+    std::lock_guard lock(mutex_);
+    file_path_ = file_path;
+    file_ = std::fopen(file_path.c_str(), "wb");
+    if (file_ == nullptr or 
+        std::fwrite(page_capture_magic, sizeof(page_capture_magic), 1, file_) != 1) {
+        std::cout << "capture error: creating " << file_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Page_capture_writer::append(const Url_t& url, const Read_Results_t& results) {
+    Page_content_t content = results.page_content();
+    Capture_record_header header{static_cast<uint32_t>(url.size()), 
+        static_cast<uint32_t>(results.http_code), results.wire_size, content.size()};
+    std::lock_guard lock(mutex_);
+    if (file_ == nullptr or write_failed_) return;
+    if (std::fwrite(&header, sizeof(header), 1, file_) != 1 or
+        std::fwrite(url.data(), 1, url.size(), file_) != url.size() or
+        std::fwrite(content.data(), 1, content.size(), file_) != content.size()) {
+        std::cout << "capture error: writing " << file_path_ << std::endl;
+        write_failed_ = true;
+        return;
+    }
+    ++num_records_;
+}
+
+void Page_capture_writer::close() {
+    std::lock_guard lock(mutex_);
+    if (file_ != nullptr) {
+        if (std::fclose(file_) != 0 and !write_failed_) {
+            std::cout << "capture error: closing " << file_path_ << std::endl;
+        }
+        file_ = nullptr;
+    }
+}
+
+Replay_page_reader::~Replay_page_reader() {
+    unmap();
+}
+
+bool Replay_page_reader::open(const std::string& file_path) {
+    unmap();
+    int fd = ::open(file_path.c_str(), O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 or ::fstat(fd, &file_stat) != 0 or 
+        static_cast<size_t>(file_stat.st_size) < sizeof(page_capture_magic)) {
+        std::cout << "replay error: opening " << file_path << std::endl;
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    mapping_size_ = file_stat.st_size;
+    void* mapping = ::mmap(nullptr, mapping_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cout << "replay error: mapping " << file_path << std::endl;
+        mapping_size_ = 0;
+        return false;
+    }
+    mapping_ = static_cast<const char*>(mapping);
+    // The index is built with one sequential pass over the records
+    ::madvise(mapping, mapping_size_, MADV_SEQUENTIAL);
+    if (std::memcmp(mapping_, page_capture_magic, sizeof(page_capture_magic)) != 0) {
+        std::cout << "replay error: " << file_path << " isn't a capture file" << std::endl;
+        unmap();
+        return false;
+    }
+    size_t pos = sizeof(page_capture_magic);
+    while (pos + sizeof(Capture_record_header) <= mapping_size_) {
+        Capture_record_header header;
+        std::memcpy(&header, mapping_ + pos, sizeof(header));
+        pos += sizeof(header);
+        if (header.url_size > mapping_size_ - pos or 
+            header.content_size > mapping_size_ - pos - header.url_size) {
+            std::cout << "replay error: " << file_path << " is truncated" << std::endl;
+            break;
+        }
+        std::string_view url(mapping_ + pos, header.url_size);
+        pos += header.url_size;
+        pages_[url] = Captured_page{static_cast<int>(header.http_code), 
+            header.wire_size, std::string_view(mapping_ + pos, header.content_size)};
+        pos += header.content_size;
+    }
+    // Pages are then read in crawl order
+    ::madvise(mapping, mapping_size_, MADV_RANDOM);
+    return true;
+}
+
+Read_Results_t Replay_page_reader::read_page(const Url_t& url, const Read_options&) {
+    Read_Results_t results{http_not_found, ""};
+    auto iter = pages_.find(url);
+    if (iter != pages_.end()) {
+        results.http_code = iter->second.http_code;
+        results.wire_size = iter->second.wire_size;
+        results.mapped_content = iter->second.content;
+    }
+    return results;
+}
+
+void Replay_page_reader::unmap() {
+    pages_.clear();
+    if (mapping_ != nullptr) {
+        ::munmap(const_cast<char*>(mapping_), mapping_size_);
+        mapping_ = nullptr;
+        mapping_size_ = 0;
+    }
+}
@@ -0,0 +1,87 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+#include <cstdio>
+#include <web_common.h>
+#include <web_page_reader.h>
+
+// A capture file is the magic followed by one record per read page:
+// u32 URL length, u32 HTTP code, u64 wire size, u64 body length, the URL, the body.
+// The fields are in host byte order, captures are replayed on the machine type that made them.
+static constexpr char page_capture_magic[8] = {'W', 'C', 'C', 'A', 'P', '0', '0', '1'};
+
+/// @brief Appends the pages a crawl reads to a capture file.
+/// This class is thread safe.
+class Page_capture_writer {
+public:
+    Page_capture_writer() = default;
+    ~Page_capture_writer();
+    Page_capture_writer(const Page_capture_writer&) = delete;
+    Page_capture_writer& operator=(const Page_capture_writer&) = delete;
+
+    /// @return false when the capture file can't be created
+    bool open(const std::string& file_path);
+    void append(const Url_t& url, const Read_Results_t& results);
+    void close();
+    size_t num_records() const {
+        return num_records_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::FILE* file_{nullptr};
+    std::string file_path_;
+    size_t num_records_{0};
+    bool write_failed_{false};
+};
+
+/// @brief Serves the pages of a capture file, for repeatable crawls without a network.
+/// The file is memory mapped and page content is returned as views into the mapping,
+/// so nothing is copied. When a URL was captured more than once, the last read of it
+/// is served. URLs that weren't captured read as 404.
+/// read_page is thread safe.
+class Replay_page_reader {
+public:
+    Replay_page_reader() = default;
+    ~Replay_page_reader();
+    Replay_page_reader(const Replay_page_reader&) = delete;
+    Replay_page_reader& operator=(const Replay_page_reader&) = delete;
+
+    /// @brief Maps the capture file and indexes its records
+    /// @return false when the file can't be mapped or isn't a capture
+    bool open(const std::string& file_path);
+    Read_Results_t read_page(const Url_t& url, const Read_options& options = Read_options{});
+    size_t num_pages() const {
+        return pages_.size();
+    }
+
+private:
+    struct Captured_page {
+        int http_code;
+        size_t wire_size;
+        std::string_view content;
+    };
+
+    const char* mapping_{nullptr};
+    size_t mapping_size_{0};
+    std::unordered_map<std::string_view, Captured_page> pages_;
+
+    void unmap();
+};
@@ -0,0 +1,139 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+
+#include <revisit_scheduler.h>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+Revisit_scheduler::Revisit_scheduler(const Revisit_config& config) : config_(config) {}
+
+Url_t Revisit_scheduler::page_key(const Page_path_t& path) {
+    return path.path + "\n" + path.page + "?" + path.query;
+}
+
+double Revisit_scheduler::estimate_change_rate(uint64_t num_intervals, uint64_t num_changes,
+    double mean_interval) {
+    if (num_intervals == 0 or mean_interval <= 0) {
+        return 0;
+    }
+    // A visit only shows whether the page changed at least once since the last one,
+    // so the changed fraction is the probability 1 - e^(-rate * interval).
+    // The 0.5s keep it finite and reduce its bias for few visits.
+    double n = static_cast<double>(num_intervals);
+    double unchanged = n - static_cast<double>(num_changes);
+    return -std::log((unchanged + 0.5) / (n + 0.5)) / mean_interval;
+}
+
+std::chrono::seconds Revisit_scheduler::revisit_interval(const Page_history& history) const {
+    if (history.num_intervals == 0) {
+        return config_.initial_interval;
+    }
+    double rate = estimate_change_rate(history.num_intervals, history.num_changes,
+        history.total_interval / history.num_intervals);
+    // Revisit about once per expected change
+    double interval = rate > 0 ? 1 / rate : static_cast<double>(config_.max_interval.count());
+    return std::chrono::seconds(static_cast<long>(std::clamp(interval,
+        static_cast<double>(config_.min_interval.count()), 
+        static_cast<double>(config_.max_interval.count()))));
+}
+
+bool Revisit_scheduler::record_visit(const Page_path_t& path, Page_content_t content,
+    Time_point_t now) {
+    uint64_t content_hash = std::hash<Page_content_t>{}(content);
+    Url_t key = page_key(path);
+    std::lock_guard lock(mutex_);
+    auto [iter, is_new] = pages_.try_emplace(key);
+    Page_history& history = iter->second;
+    bool changed = is_new;
+    ++num_visits_;
+    if (is_new) {
+        history.path = path;
+    }
+    else {
+        changed = content_hash != history.content_hash;
+        ++(changed ? num_changed_ : num_unchanged_);
+        history.total_interval += std::chrono::duration<double>(now - history.last_visit).count();
+        ++history.num_intervals;
+        history.num_changes += changed;
+    }
+    history.content_hash = content_hash;
+    history.last_visit = now;
+    history.revisit_interval = revisit_interval(history);
+    schedule(key, history, now + history.revisit_interval);
+    return changed;
+}
+
+void Revisit_scheduler::schedule(const Url_t& key, Page_history& history, 
+    Time_point_t visit_time) {
+    history.next_visit = visit_time;
+    due_pages_.push(Due_page{visit_time, key});
+}
+
+// A page is scheduled again each time it's recorded. Only its latest entry counts.
+void Revisit_scheduler::drop_stale_due_pages() {
+    while (!due_pages_.empty() and 
+        pages_.at(due_pages_.top().key).next_visit != due_pages_.top().due_time) {
+        due_pages_.pop();
+    }
+}
+
+void Revisit_scheduler::record_failure(const Page_path_t& path, Time_point_t now) {
+    Url_t key = page_key(path);
+    std::lock_guard lock(mutex_);
+    auto iter = pages_.find(key);
+    if (iter != pages_.end()) {
+        schedule(key, iter->second, now + iter->second.revisit_interval);
+    }
+}
+
+Opt_page_path_t Revisit_scheduler::pop_due(Time_point_t now) {
+    Opt_page_path_t opt_path;
+    std::lock_guard lock(mutex_);
+    drop_stale_due_pages();
+    if (!due_pages_.empty() and due_pages_.top().due_time <= now) {
+        Page_history& history = pages_.at(due_pages_.top().key);
+        opt_path = history.path;
+        // In flight until its visit is recorded
+        history.next_visit = Time_point_t::max();
+        due_pages_.pop();
+    }
+    return opt_path;
+}
+
+bool Revisit_scheduler::has_due(Time_point_t now) {
+    std::lock_guard lock(mutex_);
+    drop_stale_due_pages();
+    return !due_pages_.empty() and due_pages_.top().due_time <= now;
+}
+
+double Revisit_scheduler::change_rate(const Page_path_t& path) {
+    std::lock_guard lock(mutex_);
+    auto iter = pages_.find(page_key(path));
+    if (iter == pages_.end() or iter->second.num_intervals == 0) {
+        return 0;
+    }
+    const Page_history& history = iter->second;
+    return estimate_change_rate(history.num_intervals, history.num_changes,
+        history.total_interval / history.num_intervals);
+}
+
+size_t Revisit_scheduler::num_pages() {
+    std::lock_guard lock(mutex_);
+    return pages_.size();
+}
+
+Revisit_stats Revisit_scheduler::stats() {
+    std::lock_guard lock(mutex_);
+    return Revisit_stats{pages_.size(), num_visits_, num_changed_, num_unchanged_};
+}
@@ -0,0 +1,115 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <queue>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <web_common.h>
+
+struct Revisit_config {
+    // Revisit interval of a page after its first visit, before any change is seen
+    std::chrono::seconds initial_interval{600};
+    // Revisit intervals follow each page's estimated change rate, clamped to these
+    std::chrono::seconds min_interval{60};
+    std::chrono::seconds max_interval{7 * 24 * 3600};
+};
+
+struct Revisit_stats {
+    size_t num_pages;
+    uint64_t num_visits;
+    // Revisits that found the page's content changed
+    uint64_t num_changed;
+    // Revisits that found it unchanged
+    uint64_t num_unchanged;
+};
+
+/// @brief Keeps the pages of a continuous crawl and when to revisit each of them.
+/// Each revisit compares a hash of the content with the last visit's. The page's
+/// change rate is estimated from how many revisits found it changed, and it's 
+/// revisited about once per expected change, so fetches go to the pages that change.
+/// This class is thread safe.
+class Revisit_scheduler {
+public:
+    using Clock_t = std::chrono::steady_clock;
+    using Time_point_t = Clock_t::time_point;
+
+    Revisit_scheduler(const Revisit_config& config = Revisit_config{});
+
+    /// @brief Records a successful read of the page and schedules its next visit.
+    /// @return true when the content differs from the last visit's, or the page is new
+    bool record_visit(const Page_path_t& path, Page_content_t content,
+        Time_point_t now = Clock_t::now());
+
+    /// @brief Reschedules a known page whose read failed, keeping its estimate
+    void record_failure(const Page_path_t& path, Time_point_t now = Clock_t::now());
+
+    /// @brief Takes the page whose revisit is the most overdue, if any is due.
+    /// The page isn't scheduled again until its visit is recorded.
+    Opt_page_path_t pop_due(Time_point_t now = Clock_t::now());
+    bool has_due(Time_point_t now = Clock_t::now());
+
+    /// @brief Estimated changes per second of the page, 0 for unknown pages
+    double change_rate(const Page_path_t& path);
+
+    /// @brief Estimated change rate from visits at regular intervals 
+    /// (Cho and Garcia-Molina's estimator). It stays finite when every visit saw a change.
+    /// @param num_intervals [in] Intervals between visits
+    /// @param num_changes [in] Intervals in which the content changed
+    /// @param mean_interval [in] Mean interval in seconds
+    static double estimate_change_rate(uint64_t num_intervals, uint64_t num_changes,
+        double mean_interval);
+
+    size_t num_pages();
+    Revisit_stats stats();
+
+private:
+    struct Page_history {
+        Page_path_t path;
+        uint64_t content_hash{0};
+        Time_point_t last_visit;
+        // Seconds between the visits so far
+        double total_interval{0};
+        uint64_t num_intervals{0};
+        uint64_t num_changes{0};
+        std::chrono::seconds revisit_interval{0};
+        // Entries of due_pages_ for other times are stale
+        Time_point_t next_visit;
+    };
+    struct Due_page {
+        Time_point_t due_time;
+        Url_t key;
+        bool operator>(const Due_page& other) const {
+            return due_time > other.due_time;
+        }
+    };
+    using Due_pages_t = std::priority_queue<Due_page, std::vector<Due_page>, std::greater<Due_page>>;
+
+    const Revisit_config config_;
+    std::mutex mutex_;
+    std::unordered_map<Url_t, Page_history> pages_;
+    Due_pages_t due_pages_;
+    uint64_t num_visits_{0};
+    uint64_t num_changed_{0};
+    uint64_t num_unchanged_{0};
+
+    std::chrono::seconds revisit_interval(const Page_history& history) const;
+    void schedule(const Url_t& key, Page_history& history, Time_point_t visit_time);
+    void drop_stale_due_pages();
+    static Url_t page_key(const Page_path_t& path);
+};
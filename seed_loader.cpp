@@ -0,0 +1,183 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+
+#include <seed_loader.h>
+#include <thread_pool.h>
+#include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+Seed_loader::Seed_loader(int num_threads) : num_threads_(std::max(num_threads, 1)) {}
+
+Seed_loader::~Seed_loader() {
+    unmap();
+}
+
+bool Seed_loader::open(const std::string& file_path) {
+    unmap();
+    int fd = ::open(file_path.c_str(), O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 or ::fstat(fd, &file_stat) != 0) {
+        std::cout << "seed error: opening " << file_path << std::endl;
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    mapping_size_ = file_stat.st_size;
+    if (mapping_size_ == 0) {
+        ::close(fd);
+        return true;
+    }
+    void* mapping = ::mmap(nullptr, mapping_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cout << "seed error: mapping " << file_path << std::endl;
+        mapping_size_ = 0;
+        return false;
+    }
+    mapping_ = static_cast<const char*>(mapping);
+    // Each thread reads its chunk front to back
+    ::madvise(mapping, mapping_size_, MADV_SEQUENTIAL);
+    return true;
+}
+
+void Seed_loader::unmap() {
+    if (mapping_ != nullptr) {
+        ::munmap(const_cast<char*>(mapping_), mapping_size_);
+        mapping_ = nullptr;
+    }
+    mapping_size_ = 0;
+}
+
+// Chunks end at line ends, so no line is split between threads
+std::vector<std::string_view> Seed_loader::split_chunks(size_t num_chunks) const {
+    std::vector<std::string_view> chunks;
+    std::string_view file(mapping_, mapping_size_);
+    size_t chunk_size = (file.size() + num_chunks - 1) / num_chunks;
+    size_t begin = 0;
+    while (begin < file.size()) {
+        size_t end = std::min(begin + chunk_size, file.size());
+        end = end == file.size() ? end : std::min(file.find('\n', end), file.size());
+        chunks.push_back(file.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return chunks;
+}
+
+// Runs fcn(index) for each index in [0, num_tasks), each in its own thread
+template <class Fcn_t>
+static void run_in_parallel(size_t num_tasks, Fcn_t fcn) {
+    struct Task_ftor {
+        Fcn_t* fcn_ptr;
+        size_t index;
+        bool operator() () {
+            (*fcn_ptr)(index);
+            return false;
+        }
+    };
+    std::vector<Task_ftor> tasks;
+    for (size_t i = 0; i < num_tasks; ++i) {
+        tasks.push_back(Task_ftor{&fcn, i});
+    }
+    Thread_pool thread_pool;
+    thread_pool.run(tasks.begin(), tasks.end());
+}
+
+Page_paths_t Seed_loader::load(const Make_path_fcn_t& make_path) {
+    auto start_time = std::chrono::steady_clock::now();
+    stats_ = Seed_load_stats{};
+    std::vector<std::string_view> chunks = split_chunks(num_threads_);
+    size_t num_buckets = num_threads_;
+    // buckets[chunk][bucket]: a chunk's paths, bucketed by the hash of their URL path
+    struct Keyed_path {
+        Url_t key;
+        // Position in the file, to keep the seeds in the file's order
+        size_t seq;
+        Page_path_t path;
+    };
+    std::vector<std::vector<std::vector<Keyed_path>>> buckets(chunks.size(),
+        std::vector<std::vector<Keyed_path>>(num_buckets));
+    std::atomic<size_t> num_urls{0}, num_rejected{0}, num_duplicates{0};
+    run_in_parallel(chunks.size(), [&](size_t chunk_index) {
+        std::string_view chunk = chunks[chunk_index];
+        size_t chunk_urls = 0, chunk_rejected = 0;
+        for (size_t begin = 0; begin < chunk.size(); ) {
+            size_t end = std::min(chunk.find('\n', begin), chunk.size());
+            std::string_view line = chunk.substr(begin, end - begin);
+            begin = end + 1;
+            size_t url_begin = line.find_first_not_of(" \t\r");
+            if (url_begin == std::string_view::npos or line[url_begin] == '#') continue;
+            line = line.substr(url_begin, line.find_last_not_of(" \t\r") - url_begin + 1);
+            ++chunk_urls;
+            Opt_page_path_t opt_path = make_path(Url_t{line});
+            if (!opt_path) {
+                ++chunk_rejected;
+                continue;
+            }
+            Url_t key = opt_path->path + "\n" + opt_path->page + "?" + opt_path->query;
+            size_t bucket = std::hash<Url_t>{}(key) % num_buckets;
+            // A line's offset in the file orders it
+            buckets[chunk_index][bucket].push_back(Keyed_path{std::move(key), 
+                static_cast<size_t>(line.data() - mapping_), std::move(*opt_path)});
+        }
+        num_urls += chunk_urls;
+        num_rejected += chunk_rejected;
+    });
+    // A URL's duplicates are all in its bucket, so each bucket dedups on its own
+    // The first of a URL's duplicates in the file is kept
+    using Seq_path_t = std::pair<size_t, Page_path_t>;
+    std::vector<std::vector<Seq_path_t>> unique_paths(num_buckets);
+    run_in_parallel(num_buckets, [&](size_t bucket) {
+        std::unordered_set<Url_t> keys;
+        size_t bucket_duplicates = 0;
+        for (auto& chunk_buckets: buckets) {
+            for (Keyed_path& keyed_path: chunk_buckets[bucket]) {
+                if (keys.insert(std::move(keyed_path.key)).second) {
+                    unique_paths[bucket].emplace_back(keyed_path.seq, std::move(keyed_path.path));
+                }
+                else {
+                    ++bucket_duplicates;
+                }
+            }
+            std::vector<Keyed_path>().swap(chunk_buckets[bucket]);
+        }
+        num_duplicates += bucket_duplicates;
+    });
+    std::vector<Seq_path_t> seq_paths;
+    for (std::vector<Seq_path_t>& bucket_paths: unique_paths) {
+        seq_paths.insert(seq_paths.end(), std::make_move_iterator(bucket_paths.begin()),
+            std::make_move_iterator(bucket_paths.end()));
+        std::vector<Seq_path_t>().swap(bucket_paths);
+    }
+    std::sort(seq_paths.begin(), seq_paths.end(), 
+        [](const Seq_path_t& a, const Seq_path_t& b) { return a.first < b.first; });
+    Page_paths_t paths;
+    paths.reserve(seq_paths.size());
+    for (Seq_path_t& seq_path: seq_paths) {
+        paths.push_back(std::move(seq_path.second));
+    }
+    stats_.num_urls = num_urls;
+    stats_.num_seeds = paths.size();
+    stats_.num_rejected = num_rejected;
+    stats_.num_duplicates = num_duplicates;
+    stats_.load_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start_time);
+    return paths;
+}
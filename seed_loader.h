@@ -0,0 +1,65 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <web_common.h>
+
+struct Seed_load_stats {
+    // Lines with a URL, not counting blank and # comment lines
+    size_t num_urls{0};
+    // Unique seeds loaded
+    size_t num_seeds{0};
+    // Invalid URLs, or URLs outside the crawled site
+    size_t num_rejected{0};
+    size_t num_duplicates{0};
+    std::chrono::milliseconds load_time{0};
+};
+
+/// @brief Loads a seed file of URLs, one per line, into canonical page paths.
+/// The file is memory mapped and split into one chunk per thread. The threads 
+/// parse their chunks and bucket the paths by hash, then dedup one bucket each, 
+/// so neither step takes a lock.
+class Seed_loader {
+public:
+    /// @brief Returns the page path to crawl for a URL, or nothing to reject it.
+    /// Called concurrently from the loading threads.
+    using Make_path_fcn_t = std::function<Opt_page_path_t(const Url_t& url)>;
+
+    Seed_loader(int num_threads = std::thread::hardware_concurrency());
+    ~Seed_loader();
+    Seed_loader(const Seed_loader&) = delete;
+    Seed_loader& operator=(const Seed_loader&) = delete;
+
+    /// @return false when the file can't be mapped
+    bool open(const std::string& file_path);
+    /// @brief Parses and dedups the file's URLs in parallel
+    Page_paths_t load(const Make_path_fcn_t& make_path);
+    const Seed_load_stats& stats() const {
+        return stats_;
+    }
+
+private:
+    const int num_threads_;
+    const char* mapping_{nullptr};
+    size_t mapping_size_{0};
+    Seed_load_stats stats_;
+
+    std::vector<std::string_view> split_chunks(size_t num_chunks) const;
+    void unmap();
+};
@@ -0,0 +1,170 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+
+#include <site_stats.h>
+#include <algorithm>
+#include <utility>
+#include <url_mgr.h>
+
+Site_stats_processor::Site_stats_processor(std::ostream* log_ptr, size_t log_batch_bytes) :
+    log_ptr_(log_ptr), log_batch_bytes_(log_batch_bytes) {}
+
+Site_stats_processor::~Site_stats_processor() {
+    stop_flusher();
+}
+
+void Site_stats_processor::process_body_chunk(const Url_t& page_url, size_t offset,
+    Page_content_t chunk) {
+    Thread_stats& stats = thread_stats_.local();
+    stats.page_size = (offset == 0 ? 0 : stats.page_size) + chunk.size();
+}
+
+void Site_stats_processor::process_page_content(const Url_t& page_url,
+    const Url_t& site_domain, int http_code, int depth,
+    const Page_paths_t& page_paths, const Page_content_t&) {
+    Thread_stats& stats = thread_stats_.local();
+    size_t page_size = std::exchange(stats.page_size, 0);
+    ++stats.totals.num_pages;
+    stats.totals.num_ok_pages += http_code == http_ok;
+    stats.totals.num_bytes += page_size;
+    stats.totals.num_links += page_paths.size();
+    for (const Page_path_t& page_path: page_paths) {
+        ++stats.backlinks[Url_mgr::make_full_url(site_domain, page_path)];
+    }
+    {
+        Page_shard& shard = page_shard(page_url);
+        std::lock_guard lock(shard.mutex);
+        // A revisited page replaces its earlier stats
+        shard.pages.insert_or_assign(page_url, Site_page_stats{page_url, http_code, 
+            page_size, depth, static_cast<int>(page_paths.size()), 0});
+    }
+    if (log_ptr_) {
+        stats.log_batch.append("Process page_content for: ").append(page_url)
+            .append(" HTTP code ").append(std::to_string(http_code))
+            .append(" has ").append(std::to_string(page_size)).append(" bytes")
+            .append(" and has ").append(std::to_string(page_paths.size())).append(" links\n");
+        if (stats.log_batch.size() >= log_batch_bytes_) {
+            queue_log_batch(stats.log_batch);
+        }
+        charge_work(stats.log_charge, stats.log_batch.size());
+    }
+}
+
+void Site_stats_processor::final() {
+    // The crawling threads are done, so their stats can be merged from here
+    totals_ = Site_totals{};
+    thread_stats_.for_each([this](Thread_stats& stats) {
+        totals_.num_pages += stats.totals.num_pages;
+        totals_.num_ok_pages += stats.totals.num_ok_pages;
+        totals_.num_bytes += stats.totals.num_bytes;
+        totals_.num_links += stats.totals.num_links;
+        for (const auto& [url, num_backlinks]: stats.backlinks) {
+            Page_shard& shard = page_shard(url);
+            auto iter = shard.pages.find(url);
+            if (iter != shard.pages.end()) {
+                iter->second.num_backlinks += num_backlinks;
+            }
+        }
+        stats.backlinks.clear();
+        if (!stats.log_batch.empty()) {
+            queue_log_batch(stats.log_batch);
+        }
+        stats.log_charge.reset();
+    });
+    stop_flusher();
+    queued_log_charge_.reset();
+    is_done_ = true;
+}
+
+std::vector<Site_page_stats> Site_stats_processor::snapshot() {
+    std::vector<Site_page_stats> pages;
+    for (Page_shard& shard: page_shards_) {
+        std::lock_guard lock(shard.mutex);
+        for (const auto& page: shard.pages) {
+            pages.push_back(page.second);
+        }
+    }
+    std::sort(pages.begin(), pages.end(), 
+        [](const Site_page_stats& a, const Site_page_stats& b) { return a.url < b.url; });
+    return pages;
+}
+
+void Site_stats_processor::print_site_info(std::ostream& out) {
+    if (!is_done_) {
+        out << "Site crawling is still in progress..." << std::endl;
+        return;
+    }
+    for (const Site_page_stats& page: snapshot()) {
+        out << "Page: " << page.url <<
+            ", code: " << page.http_code <<
+            ", size: " << page.size <<
+            ", depth: " << page.depth <<
+            ", links: " << page.num_links <<
+            ", backlinks: " << page.num_backlinks << "\n";
+    }
+    out << "Site totals: " << totals_.num_pages << " pages, " << totals_.num_ok_pages <<
+        " OK, " << totals_.num_bytes << " bytes, " << totals_.num_links << " links" << std::endl;
+}
+
+void Site_stats_processor::queue_log_batch(std::string& log_batch) {
+    {
+        std::lock_guard lock(log_mutex_);
+        // The charge follows the batch until it's written
+        charge_work(queued_log_charge_, (queued_log_charge_ ? queued_log_charge_->bytes() : 0) +
+            log_batch.size());
+        log_batches_.push_back(std::move(log_batch));
+        // Started by the first batch, and again by a crawl after final()
+        if (!flusher_.joinable()) {
+            stop_flusher_ = false;
+            flusher_ = std::thread(&Site_stats_processor::flush_logs, this);
+        }
+    }
+    log_cv_.notify_one();
+    log_batch.clear();
+}
+
+void Site_stats_processor::flush_logs() {
+    std::unique_lock lock(log_mutex_);
+    for (;;) {
+        log_cv_.wait(lock, [this] { return !log_batches_.empty() or stop_flusher_; });
+        if (log_batches_.empty()) {
+            break;
+        }
+        std::vector<std::string> batches;
+        batches.swap(log_batches_);
+        // The crawling threads keep queuing while the batches are written
+        lock.unlock();
+        size_t num_bytes = 0;
+        for (const std::string& batch: batches) {
+            log_ptr_->write(batch.data(), batch.size());
+            num_bytes += batch.size();
+        }
+        log_ptr_->flush();
+        lock.lock();
+        if (queued_log_charge_) {
+            queued_log_charge_->resize(queued_log_charge_->bytes() - num_bytes);
+        }
+    }
+}
+
+// Returns once the queued batches are written
+void Site_stats_processor::stop_flusher() {
+    {
+        std::lock_guard lock(log_mutex_);
+        stop_flusher_ = true;
+    }
+    log_cv_.notify_one();
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+}
@@ -0,0 +1,118 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <ostream>
+#include <optional>
+#include <per_thread.h>
+#include <web_common.h>
+#include <web_crawler.h>
+
+struct Site_page_stats {
+    Url_t url;
+    int http_code;
+    size_t size;
+    int depth;
+    int num_links;
+    // Links to the page from the crawled pages
+    int num_backlinks;
+};
+
+struct Site_totals {
+    size_t num_pages;
+    size_t num_ok_pages;
+    size_t num_bytes;
+    size_t num_links;
+};
+
+/// @brief Page processor that collects each page's size, links and backlinks,
+/// and logs a line per page. 
+/// The pages are kept in a sharded map, so threads only contend when they
+/// hit the same shard. Totals, backlinks and log lines accumulate per thread.
+/// Full log buffers are written by a background thread, so the crawling 
+/// threads never wait on the log's stream.
+class Site_stats_processor : public Page_content_processor {
+public:
+    /// @param log_ptr [in] Stream for the per-page log lines, or nullptr for no log
+    /// @param log_batch_bytes [in] Bytes of log lines each thread buffers before handing them off
+    Site_stats_processor(std::ostream* log_ptr = nullptr, size_t log_batch_bytes = 64 * 1024);
+    ~Site_stats_processor();
+    Site_stats_processor(const Site_stats_processor&) = delete;
+    Site_stats_processor& operator=(const Site_stats_processor&) = delete;
+
+    // Pages are sized as they stream in, so their content isn't kept
+    unsigned needs() const override {
+        return processor_needs_links | processor_needs_body_stream;
+    }
+    void process_body_chunk(const Url_t& page_url, size_t offset,
+        Page_content_t chunk) override;
+    void process_page_content(const Url_t& page_url,
+        const Url_t& site_domain, int http_code, int depth,
+        const Page_paths_t& page_paths, const Page_content_t& page_content) override;
+
+    /// @brief Merges the threads' backlinks and totals, and writes the rest of the log
+    void final() override;
+
+    // The methods below are valid after final()
+    /// @brief Merged snapshot of every page's stats, in URL order
+    std::vector<Site_page_stats> snapshot();
+    Site_totals totals() const {
+        return totals_;
+    }
+    /// @brief Prints every page's stats and the site's totals
+    void print_site_info(std::ostream& out);
+
+private:
+    enum { num_page_shards = 64 };
+    struct Page_shard {
+        std::mutex mutex;
+        std::unordered_map<Url_t, Site_page_stats> pages;
+    };
+    struct Thread_stats {
+        Site_totals totals{};
+        // Size of the page streaming in on this thread
+        size_t page_size{0};
+        std::unordered_map<Url_t, int> backlinks;
+        std::string log_batch;
+        std::optional<Memory_charge> log_charge;
+    };
+
+    std::ostream* const log_ptr_;
+    const size_t log_batch_bytes_;
+    bool is_done_{false};
+    Site_totals totals_{};
+    std::array<Page_shard, num_page_shards> page_shards_;
+    Per_thread<Thread_stats> thread_stats_;
+    // Log batches waiting for the flusher thread
+    std::mutex log_mutex_;
+    std::condition_variable log_cv_;
+    std::vector<std::string> log_batches_;
+    std::optional<Memory_charge> queued_log_charge_;
+    bool stop_flusher_{false};
+    std::thread flusher_;
+
+    Page_shard& page_shard(const Url_t& url) {
+        return page_shards_[std::hash<Url_t>{}(url) % num_page_shards];
+    }
+    void queue_log_batch(std::string& log_batch);
+    void flush_logs();
+    void stop_flusher();
+};
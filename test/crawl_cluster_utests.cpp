@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <crawl_cluster.h>
+
+extern "C" {
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+}
+
+TEST(Url_hash_ring, Owner_Is_Stable_And_Balanced) {
+    constexpr const int num_nodes{4};
+    constexpr const int num_paths{4000};
+    Url_hash_ring ring(num_nodes);
+    Url_hash_ring same_ring(num_nodes);
+    std::vector<int> counts(num_nodes, 0);
+    for (int i = 0; i < num_paths; ++i) {
+        Url_t path = "/docs/page" + std::to_string(i) + ".html";
+        int owner = ring.owner(path);
+        ASSERT_TRUE(owner >= 0 and owner < num_nodes);
+        EXPECT_EQ(owner, same_ring.owner(path));
+        ++counts[owner];
+    }
+    for (int count: counts) {
+        EXPECT_GT(count, num_paths / num_nodes / 2);
+    }
+}
+
+TEST(Url_hash_ring, Adding_Node_Moves_Few_Paths) {
+    constexpr const int num_paths{4000};
+    Url_hash_ring ring(4), bigger_ring(5);
+    int moved = 0;
+    for (int i = 0; i < num_paths; ++i) {
+        Url_t path = "/p" + std::to_string(i);
+        int owner = bigger_ring.owner(path);
+        if (owner != ring.owner(path)) {
+            // Only paths claimed by the new node should move
+            EXPECT_EQ(owner, 4);
+            ++moved;
+        }
+    }
+    EXPECT_LT(moved, num_paths / 2);
+}
+
+static bool wait_for(std::function<bool()> cond) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!cond()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+TEST(Crawl_cluster_node, Forwards_Paths_And_Detects_Termination) {
+    Cluster_node_addrs_t nodes{{"127.0.0.1", 47411}, {"127.0.0.1", 47412}};
+    Crawl_cluster_node node0(0, nodes), node1(1, nodes);
+    ASSERT_TRUE(node0.start());
+    ASSERT_TRUE(node1.start());
+
+    Page_paths_t node1_paths;
+    for (int i = 0; node1_paths.size() < 10; ++i) {
+        Page_path_t path{"/docs/", "p" + std::to_string(i) + ".html", 2};
+        if (!node0.owns(path)) {
+            EXPECT_TRUE(node1.owns(path));
+            node1_paths.push_back(path);
+        }
+    }
+    node0.forward_paths(node1_paths);
+    // Going idle flushes the partial batch
+    EXPECT_FALSE(node0.is_cluster_done());
+
+    Page_paths_t received;
+    ASSERT_TRUE(wait_for([&] {
+        Page_paths_t paths = node1.take_received_paths();
+        received.insert(received.end(), paths.begin(), paths.end());
+        return received.size() == node1_paths.size();
+    }));
+    EXPECT_EQ(received.front().page, node1_paths.front().page);
+    EXPECT_EQ(received.front().depth, 2);
+
+    // Node 1 has processed its paths and goes idle too
+    EXPECT_TRUE(wait_for([&] { return node1.is_cluster_done(); }));
+    EXPECT_TRUE(wait_for([&] { return node0.is_cluster_done(); }));
+}
+
+TEST(Crawl_cluster_node, Owner_Uses_Crawl_Canon_Rules) {
+    Cluster_node_addrs_t nodes{{"127.0.0.1", 47413}, {"127.0.0.1", 47414}};
+    Url_canon_rules rules;
+    rules.index_pages = {"home.html"};
+    Crawl_cluster_node node(0, nodes, rules);
+    for (int i = 0; i < 100; ++i) {
+        // With the default rules, home.html isn't its directory's index page
+        Url_t dir = "/d" + std::to_string(i) + "/";
+        EXPECT_EQ(node.owns(Page_path_t{dir, "home.html", 2}), node.owns(Page_path_t{dir, "", 2}));
+    }
+}
+
+TEST(Crawl_cluster_node, Drops_Peer_With_Oversized_Message) {
+    Cluster_node_addrs_t nodes{{"127.0.0.1", 47415}, {"127.0.0.1", 47416}};
+    Crawl_cluster_node node(0, nodes);
+    ASSERT_TRUE(node.start());
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(47415);
+    ::inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    timeval timeout{2, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    // A paths message that claims a payload just over the limit, in network byte order
+    uint32_t header[2]{htonl(1), htonl(64 * 1024 * 1024 + 1)};
+    ASSERT_EQ(::send(fd, header, sizeof(header), 0), static_cast<ssize_t>(sizeof(header)));
+    // The node closes the connection instead of waiting for the payload
+    char byte;
+    EXPECT_EQ(::recv(fd, &byte, 1, 0), 0);
+    ::close(fd);
+    node.stop();
+}
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <chrono>
+#include <host_health.h>
+
+using namespace std::chrono_literals;
+
+static const std::string host{"http://example.com"};
+
+TEST(Host_health, Deadline_Adapts_To_P99) {
+    Host_health_config config;
+    Host_health health(config);
+    EXPECT_EQ(health.deadline_ms(host), config.max_deadline_ms);
+    for (int i = 0; i < 128; ++i) {
+        health.record(host, std::chrono::milliseconds(i < 125 ? 100 : 900), true);
+    }
+    // The slowest 3 of 128 set the p99 at 900 ms. 
+    // stats() refreshes the percentiles, which are otherwise updated periodically.
+    EXPECT_EQ(health.stats()[0].p99_ms, 900);
+    EXPECT_EQ(health.deadline_ms(host), static_cast<long>(900 * config.deadline_p99_factor));
+    for (int i = 0; i < 512; ++i) {
+        health.record(host, 10ms, true);
+    }
+    // Fast hosts still get the minimum deadline
+    EXPECT_EQ(health.deadline_ms(host), config.min_deadline_ms);
+    std::vector<Host_latency_stats> stats = health.stats();
+    ASSERT_EQ(stats.size(), 1u);
+    EXPECT_EQ(stats[0].p50_ms, 10);
+    EXPECT_EQ(stats[0].num_requests, 640u);
+}
+
+TEST(Host_health, Breaker_Parks_Host_Until_Probe_Succeeds) {
+    Host_health_config config;
+    Host_health health(config);
+    auto now = Host_health::Clock_t::now();
+    for (int i = 0; i < config.breaker_failure_threshold - 1; ++i) {
+        health.record(host, 100ms, false, now);
+    }
+    EXPECT_EQ(health.parked_until(host, now), now);
+    health.record(host, 100ms, false, now);
+    auto open_until = now + std::chrono::milliseconds(config.breaker_open_ms);
+    EXPECT_EQ(health.parked_until(host, now), open_until);
+
+    // The first request after the open period is the probe, the rest wait for it
+    EXPECT_EQ(health.parked_until(host, open_until), open_until);
+    EXPECT_GT(health.parked_until(host, open_until), open_until);
+    // A failed probe reopens the breaker for twice as long
+    health.record(host, 100ms, false, open_until);
+    auto reopen_until = open_until + std::chrono::milliseconds(2 * config.breaker_open_ms);
+    EXPECT_EQ(health.parked_until(host, open_until), reopen_until);
+
+    EXPECT_EQ(health.parked_until(host, reopen_until), reopen_until);
+    health.record(host, 100ms, true, reopen_until);
+    EXPECT_EQ(health.parked_until(host, reopen_until), reopen_until);
+    EXPECT_EQ(health.stats()[0].num_breaker_trips, 2u);
+}
+
+TEST(Host_health, Retry_Delay_Is_Bounded) {
+    Host_health_config config;
+    Host_health health(config);
+    for (int retry = 0; retry < 40; ++retry) {
+        auto delay = health.retry_delay(retry);
+        EXPECT_GE(delay.count(), 0);
+        EXPECT_LE(delay.count(), std::min(config.backoff_max_ms, 
+            config.backoff_base_ms << std::min(retry, 20)));
+    }
+    EXPECT_TRUE(Host_health::is_retryable(http_request_timeout));
+    EXPECT_TRUE(Host_health::is_retryable(http_service_unavailable));
+    EXPECT_FALSE(Host_health::is_retryable(http_not_found));
+    EXPECT_FALSE(Host_health::is_retryable(http_ok));
+}
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <link_graph.h>
+
+static Page_id_t id_of(const Link_graph_processor& graph, const Url_t& url) {
+    auto id = graph.find_id(url);
+    EXPECT_TRUE(id.has_value());
+    return id.value_or(0);
+}
+
+TEST(Link_graph_processor, Counts_Backlinks_To_Pages_Seen_Later) {
+    Link_graph_processor graph(4);
+    // b.html is linked to before it is processed, and a.html links to it twice
+    Page_paths_t a_links{{"/", "b.html", 2}, {"/", "b.html", 2}, {"/", "c.html", 2}};
+    Page_paths_t b_links{{"/", "c.html", 3}};
+    Page_paths_t c_links{{"/", "a.html", 3}};
+    graph.process_page_content("http://x.com/a.html", "http://x.com", 200, 1, a_links, "");
+    graph.process_page_content("http://x.com/b.html", "http://x.com", 200, 2, b_links, "");
+    graph.process_page_content("http://x.com/c.html", "http://x.com", 200, 2, c_links, "");
+    graph.final();
+
+    ASSERT_EQ(graph.num_pages(), 3u);
+    EXPECT_EQ(graph.num_links(), 4u);
+    EXPECT_EQ(graph.in_degree(id_of(graph, "http://x.com/a.html")), 1u);
+    EXPECT_EQ(graph.in_degree(id_of(graph, "http://x.com/b.html")), 1u);
+    EXPECT_EQ(graph.in_degree(id_of(graph, "http://x.com/c.html")), 2u);
+    EXPECT_EQ(graph.out_degree(id_of(graph, "http://x.com/a.html")), 2u);
+}
+
+TEST(Link_graph_processor, Variants_Of_A_Page_Are_One_Node) {
+    Link_graph_processor graph(2);
+    Page_paths_t docs_links{{"/docs/", "index.html", 2}, {"/docs/", "a.html", 2}};
+    Page_paths_t a_links{{"/docs", "", 3}};
+    graph.process_page_content("http://x.com/docs/", "http://x.com", 200, 1, docs_links, "");
+    graph.process_page_content("http://x.com/docs/a.html", "http://x.com", 200, 2, a_links, "");
+    graph.final();
+
+    // The index page is the docs page itself, so its link is a self link
+    ASSERT_EQ(graph.num_pages(), 2u);
+    EXPECT_EQ(graph.num_links(), 2u);
+    Page_id_t docs_id = id_of(graph, "http://x.com/docs/index.html");
+    EXPECT_EQ(docs_id, id_of(graph, "http://x.com/docs"));
+    EXPECT_EQ(graph.url(docs_id), "http://x.com/docs/");
+    EXPECT_EQ(graph.in_degree(docs_id), 1u);
+}
+
+TEST(Link_graph_processor, Page_Ranks_Sum_To_One) {
+    constexpr const int num_pages{1000};
+    Link_graph_processor graph(8);
+    // Every page links to the hub and the next page. The last page is a dead end.
+    for (int i = 1; i < num_pages; ++i) {
+        Url_t url = "p" + std::to_string(i);
+        graph.add_link(url, "hub");
+        if (i + 1 < num_pages) {
+            graph.add_link(url, "p" + std::to_string(i + 1));
+        }
+    }
+    graph.add_link("hub", "p1");
+    graph.final();
+
+    ASSERT_EQ(graph.num_pages(), static_cast<size_t>(num_pages));
+    double rank_sum = 0.0;
+    for (Page_id_t id = 0; id < graph.num_pages(); ++id) {
+        rank_sum += graph.page_rank(id);
+    }
+    EXPECT_NEAR(rank_sum, 1.0, 1e-6);
+    std::vector<Page_id_t> top = graph.top_pages(2);
+    ASSERT_EQ(top.size(), 2u);
+    EXPECT_EQ(graph.url(top[0]), "hub");
+    EXPECT_EQ(graph.url(top[1]), "p1");
+}
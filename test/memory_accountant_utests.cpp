@@ -0,0 +1,49 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include <memory_accountant.h>
+
+TEST(Memory_accountant, Tracks_Current_And_Peak) {
+    Memory_accountant accountant(1000);
+    EXPECT_TRUE(accountant.has_room(1000));
+    {
+        Memory_charge page{accountant, memory_page_buffers, 600};
+        Memory_charge links{accountant, memory_link_batches, 100};
+        EXPECT_EQ(accountant.current_bytes(), 700u);
+        EXPECT_EQ(accountant.current_bytes(memory_link_batches), 100u);
+        EXPECT_FALSE(accountant.has_room(400));
+        page.resize(200);
+        EXPECT_TRUE(accountant.has_room(400));
+        page.resize(900);
+        EXPECT_EQ(accountant.current_bytes(memory_page_buffers), 900u);
+        EXPECT_FALSE(accountant.try_charge(memory_page_buffers, 1));
+    }
+    ASSERT_TRUE(accountant.try_charge(memory_page_buffers, 1000));
+    Memory_charge adopted{accountant, memory_page_buffers, 1000, std::adopt_lock};
+    adopted.resize(0);
+    Memory_stats stats = accountant.stats();
+    EXPECT_EQ(stats.current_bytes, 0u);
+    EXPECT_EQ(stats.peak_bytes, 1000u);
+    accountant.reset_stats();
+    EXPECT_EQ(accountant.stats().peak_bytes, 0u);
+    // No budget is unlimited
+    EXPECT_TRUE(Memory_accountant{}.has_room(SIZE_MAX / 2));
+}
+
+TEST(Memory_accountant, Counts_Across_Threads) {
+    Memory_accountant accountant;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&accountant] {
+            for (int j = 0; j < 1000; ++j) {
+                Memory_charge charge{accountant, memory_processor_work, 10};
+            }
+        });
+    }
+    for (std::thread& thread: threads) {
+        thread.join();
+    }
+    EXPECT_EQ(accountant.current_bytes(), 0u);
+    EXPECT_GE(accountant.stats().peak_bytes, 10u);
+    EXPECT_LE(accountant.stats().peak_bytes, 40u);
+}
@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <filesystem>
+#include <page_archive.h>
+
+extern "C" {
+#include <zlib.h>
+}
+
+static std::string archive_dir(const char* name) {
+    std::string dir = (std::filesystem::temp_directory_path() / name).string();
+    std::filesystem::remove_all(dir);
+    return dir;
+}
+
+static std::string read_file(const std::string& file_path) {
+    std::ifstream in(file_path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static std::vector<Page_archive_index_entry> read_index(const std::string& file_path) {
+    std::string content = read_file(file_path);
+    std::vector<Page_archive_index_entry> entries(content.size() / sizeof(Page_archive_index_entry));
+    std::memcpy(entries.data(), content.data(), entries.size() * sizeof(Page_archive_index_entry));
+    return entries;
+}
+
+static std::string gunzip(const std::string& compressed) {
+    std::string record(64 * 1024, '\0');
+    z_stream strm{};
+    inflateInit2(&strm, 16 + MAX_WBITS);
+    strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+    strm.avail_in = compressed.size();
+    strm.next_out = reinterpret_cast<Bytef*>(record.data());
+    strm.avail_out = record.size();
+    int status = inflate(&strm, Z_FINISH);
+    record.resize(status == Z_STREAM_END ? strm.total_out : 0);
+    inflateEnd(&strm);
+    return record;
+}
+
+static std::string record_id(const std::string& record) {
+    size_t pos = record.find("WARC-Record-ID: ");
+    return pos == std::string::npos ? "" : record.substr(pos, record.find("\r\n", pos) - pos);
+}
+
+static const std::vector<Url_t> page_urls{"http://x.com/a.html", "http://x.com/b.html",
+    "http://x.com/c.html"};
+
+static void archive_pages(Page_archive_processor& archive) {
+    for (size_t i = 0; i < page_urls.size(); ++i) {
+        // The pages are archived within the same second, so their WARC dates match
+        archive.process_page_content(page_urls[i], "http://x.com", i == 2 ? 404 : 200, 1, {},
+            "<html>page " + std::to_string(i) + "</html>");
+    }
+    archive.final();
+}
+
+TEST(Page_archive, Indexes_Plain_And_Gzip_Records) {
+    for (bool compress: {false, true}) {
+        std::string dir = archive_dir("page_archive_utests");
+        Page_archive_config config{.dir = dir, .compress = compress, .batch_bytes = 1};
+        Page_archive_processor archive(config);
+        ASSERT_TRUE(archive.open());
+        archive_pages(archive);
+        EXPECT_EQ(archive.num_records(), page_urls.size());
+        EXPECT_EQ(archive.num_segments(), 1);
+
+        std::string segment = read_file(dir + (compress ? "/crawl-00000.warc.gz" :
+            "/crawl-00000.warc"));
+        std::vector<Page_archive_index_entry> entries = read_index(dir + "/crawl-00000.idx");
+        ASSERT_EQ(entries.size(), page_urls.size());
+        EXPECT_EQ(archive.bytes_written(), segment.size());
+        uint64_t offset = 0;
+        std::vector<std::string> record_ids;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            EXPECT_EQ(entries[i].url_hash, Page_archive_processor::hash_url(page_urls[i]));
+            EXPECT_EQ(entries[i].offset, offset);
+            EXPECT_EQ(entries[i].http_code, i == 2 ? 404u : 200u);
+            offset += entries[i].length;
+            ASSERT_LE(offset, segment.size());
+            std::string record = segment.substr(entries[i].offset, entries[i].length);
+            if (compress) {
+                record = gunzip(record);
+            }
+            EXPECT_EQ(record.rfind("WARC/1.0\r\n", 0), 0u);
+            EXPECT_NE(record.find("WARC-Target-URI: " + page_urls[i] + "\r\n"), std::string::npos);
+            EXPECT_NE(record.find("<html>page " + std::to_string(i) + "</html>"),
+                std::string::npos);
+            record_ids.push_back(record_id(record));
+            for (size_t j = 0; j < i; ++j) {
+                EXPECT_NE(record_ids[j], record_ids[i]);
+            }
+        }
+        EXPECT_EQ(offset, segment.size());
+        std::filesystem::remove_all(dir);
+    }
+}
+
+TEST(Page_archive, Rotates_Full_Segments) {
+    std::string dir = archive_dir("page_archive_utests_rotate");
+    // Each segment is full after one record
+    Page_archive_config config{.dir = dir, .max_segment_bytes = 1, .batch_bytes = 1};
+    Page_archive_processor archive(config);
+    ASSERT_TRUE(archive.open());
+    archive_pages(archive);
+    ASSERT_EQ(archive.num_segments(), 3);
+    for (int segment_num = 0; segment_num < 3; ++segment_num) {
+        std::string path = dir + "/crawl-0000" + std::to_string(segment_num);
+        std::string segment = read_file(path + ".warc");
+        std::vector<Page_archive_index_entry> entries = read_index(path + ".idx");
+        ASSERT_EQ(entries.size(), 1u);
+        EXPECT_EQ(entries[0].offset, 0u);
+        EXPECT_EQ(entries[0].length, segment.size());
+        EXPECT_EQ(entries[0].url_hash, Page_archive_processor::hash_url(page_urls[segment_num]));
+    }
+    std::filesystem::remove_all(dir);
+}
+
+TEST(Page_archive, Charges_Buffered_Records) {
+    std::string dir = archive_dir("page_archive_utests_charge");
+    Page_archive_config config{.dir = dir};
+    Page_archive_processor archive(config);
+    ASSERT_TRUE(archive.open());
+    Memory_accountant memory;
+    archive.set_memory_accountant(&memory);
+    archive.process_page_content(page_urls[0], "http://x.com", 200, 1, {}, "<html></html>");
+    size_t num_bytes = memory.current_bytes(memory_processor_work);
+    EXPECT_GT(num_bytes, 0u);
+    // The record stays buffered until the batch fills or final()
+    archive.process_page_content(page_urls[1], "http://x.com", 200, 1, {}, "<html></html>");
+    EXPECT_GT(memory.current_bytes(memory_processor_work), num_bytes);
+    archive.final();
+    EXPECT_EQ(memory.current_bytes(memory_processor_work), 0u);
+    EXPECT_EQ(memory.current_bytes(), 0u);
+    std::filesystem::remove_all(dir);
+}
+
+TEST(Page_archive, Archives_String_Content_Through_Base) {
+    std::string dir = archive_dir("page_archive_utests_string");
+    Page_archive_config config{.dir = dir};
+    Page_archive_processor archive(config);
+    ASSERT_TRUE(archive.open());
+    // Processors called with the std::string signature still get their pages
+    Page_content_processor& processor = archive;
+    std::string content = "<html>string page</html>";
+    processor.process_page_content(page_urls[0], "http://x.com", 200, 1, {}, content);
+    processor.final();
+    EXPECT_EQ(archive.num_records(), 1u);
+    EXPECT_NE(read_file(dir + "/crawl-00000.warc").find(content), std::string::npos);
+    std::filesystem::remove_all(dir);
+}
+
+TEST(Page_archive, Records_Response_Headers) {
+    std::string dir = archive_dir("page_archive_utests_headers");
+    Page_archive_config config{.dir = dir};
+    Page_archive_processor archive(config);
+    ASSERT_TRUE(archive.open());
+    std::string content = "<html>decoded</html>";
+    archive.process_response_headers(page_urls[0], "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/html; charset=utf-8\r\nContent-Encoding: gzip\r\n"
+        "Content-Length: 12\r\nServer: test\r\n\r\n");
+    archive.process_page_content(page_urls[0], "http://x.com", 200, 1, {}, content);
+    // A page without headers, like a replayed one, only has its status
+    archive.process_page_content(page_urls[1], "http://x.com", 404, 1, {}, content);
+    archive.final();
+    std::string segment = read_file(dir + "/crawl-00000.warc");
+    std::string content_length = "Content-Length: " + std::to_string(content.size()) + "\r\n";
+    // The headers are kept as received, except those framing the encoded body
+    EXPECT_NE(segment.find("\r\n\r\nHTTP/1.1 200 OK\r\n"
+        "Content-Type: text/html; charset=utf-8\r\nServer: test\r\n" + content_length +
+        "\r\n" + content), std::string::npos);
+    EXPECT_EQ(segment.find("Content-Encoding"), std::string::npos);
+    EXPECT_NE(segment.find("\r\n\r\nHTTP/1.1 404\r\n" + content_length + "\r\n" + content),
+        std::string::npos);
+    std::filesystem::remove_all(dir);
+}
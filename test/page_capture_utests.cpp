@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <set>
+#include <mutex>
+#include <filesystem>
+#include <page_capture.h>
+#include <web_crawler.h>
+
+static std::string capture_path(const char* name) {
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+TEST(Page_capture, Replays_Recorded_Pages_Without_Copies) {
+    std::string file_path = capture_path("page_capture_utests.cap");
+    {
+        Page_capture_writer writer;
+        ASSERT_TRUE(writer.open(file_path));
+        writer.append("http://x.com/a.html", Read_Results_t{http_ok, "page a", 3});
+        writer.append("http://x.com/b.html", Read_Results_t{http_service_unavailable, ""});
+        // The retry succeeded, so replays serve it
+        writer.append("http://x.com/b.html", Read_Results_t{http_ok, "page b"});
+        EXPECT_EQ(writer.num_records(), 3u);
+    }
+    Replay_page_reader reader;
+    ASSERT_TRUE(reader.open(file_path));
+    EXPECT_EQ(reader.num_pages(), 2u);
+    Read_Results_t a_results = reader.read_page("http://x.com/a.html");
+    EXPECT_EQ(a_results.http_code, http_ok);
+    EXPECT_EQ(a_results.page_content(), "page a");
+    EXPECT_EQ(a_results.wire_size, 3u);
+    EXPECT_TRUE(a_results.content.empty());
+    // Each read views the same mapped bytes
+    EXPECT_EQ(reader.read_page("http://x.com/a.html").page_content().data(), 
+        a_results.page_content().data());
+    Read_Results_t b_results = reader.read_page("http://x.com/b.html");
+    EXPECT_EQ(b_results.http_code, http_ok);
+    EXPECT_EQ(b_results.page_content(), "page b");
+    EXPECT_EQ(reader.read_page("http://x.com/c.html").http_code, http_not_found);
+    std::filesystem::remove(file_path);
+}
+
+TEST(Page_capture, Rejects_Non_Capture_Files) {
+    std::string file_path = capture_path("page_capture_utests.txt");
+    std::FILE* file = std::fopen(file_path.c_str(), "w");
+    std::fputs("not a capture file", file);
+    std::fclose(file);
+    Replay_page_reader reader;
+    EXPECT_FALSE(reader.open(file_path));
+    EXPECT_FALSE(reader.open(capture_path("page_capture_utests.missing")));
+    std::filesystem::remove(file_path);
+}
+
+class Url_collector {
+public:
+    void process_page_content(const Url_t& page_url, const Url_t&, int, int,
+        const Page_paths_t&, const Page_content_t&) {
+        std::lock_guard lock(mutex_);
+        urls_.insert(page_url);
+    }
+    void final() {}
+    std::set<Url_t> urls_;
+
+private:
+    std::mutex mutex_;
+};
+
+TEST(Page_capture, Crawls_A_Replayed_Site) {
+    std::string file_path = capture_path("page_capture_utests_site.cap");
+    {
+        Page_capture_writer writer;
+        ASSERT_TRUE(writer.open(file_path));
+        writer.append("http://x.com/site/", Read_Results_t{http_ok, 
+            "<a href=\"a.html\">a</a><a href=\"b.html\">b</a>"});
+        writer.append("http://x.com/site/a.html", Read_Results_t{http_ok, "<a href=\"c.html\">c</a>"});
+        writer.append("http://x.com/site/b.html", Read_Results_t{http_ok, ""});
+        writer.append("http://x.com/site/c.html", Read_Results_t{http_ok, "<a href=\"/\">top</a>"});
+    }
+    Basic_web_crawler<Replay_page_reader, Url_mgr, Url_collector> crawler(3);
+    ASSERT_TRUE(crawler.reader().open(file_path));
+    Url_collector collector;
+    Crawl_result_t result = crawler.crawl("http://x.com/site/", &collector);
+    ASSERT_TRUE(static_cast<bool>(result));
+    EXPECT_EQ(collector.urls_, (std::set<Url_t>{"http://x.com/site/", "http://x.com/site/a.html",
+        "http://x.com/site/b.html", "http://x.com/site/c.html"}));
+    std::filesystem::remove(file_path);
+}
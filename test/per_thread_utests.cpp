@@ -0,0 +1,25 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include <per_thread.h>
+
+TEST(Per_thread, Alternating_Instances_Keep_Their_Items) {
+    Per_thread<int> counts_a;
+    Per_thread<int> counts_b;
+    for (int i = 0; i < 10; ++i) {
+        ++counts_a.local();
+        counts_b.local() += 2;
+    }
+    std::thread([&] {
+        ++counts_a.local();
+        ++counts_b.local();
+        ++counts_a.local();
+    }).join();
+    std::vector<int> items_a;
+    counts_a.for_each([&items_a](int& count) { items_a.push_back(count); });
+    std::vector<int> items_b;
+    counts_b.for_each([&items_b](int& count) { items_b.push_back(count); });
+    // One item per thread, however often the thread switched instances
+    EXPECT_EQ(items_a, (std::vector<int>{10, 2}));
+    EXPECT_EQ(items_b, (std::vector<int>{20, 1}));
+}
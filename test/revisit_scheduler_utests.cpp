@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <revisit_scheduler.h>
+
+using namespace std::chrono_literals;
+
+static const Page_path_t page_a{"/docs/", "a.html", 2};
+static const Page_path_t page_b{"/docs/", "b.html", 2};
+
+TEST(Revisit_scheduler, Estimates_Change_Rate) {
+    EXPECT_EQ(Revisit_scheduler::estimate_change_rate(0, 0, 60), 0);
+    EXPECT_EQ(Revisit_scheduler::estimate_change_rate(10, 0, 60), 0);
+    // Changing on every visit stays finite, and is faster than on half of them
+    double always = Revisit_scheduler::estimate_change_rate(10, 10, 60);
+    double half = Revisit_scheduler::estimate_change_rate(10, 5, 60);
+    EXPECT_TRUE(std::isfinite(always));
+    EXPECT_GT(always, half);
+    EXPECT_NEAR(half, -std::log(5.5 / 10.5) / 60, 1e-12);
+}
+
+TEST(Revisit_scheduler, Revisits_Changing_Pages_Sooner) {
+    Revisit_config config;
+    config.initial_interval = 100s;
+    config.min_interval = 10s;
+    config.max_interval = 10000s;
+    Revisit_scheduler scheduler(config);
+    auto now = Revisit_scheduler::Clock_t::now();
+    EXPECT_TRUE(scheduler.record_visit(page_a, "a0", now));
+    EXPECT_TRUE(scheduler.record_visit(page_b, "b", now));
+    EXPECT_FALSE(scheduler.pop_due(now + 99s));
+    ASSERT_TRUE(scheduler.has_due(now + 100s));
+    for (int visit = 1; visit <= 5; ++visit) {
+        now += 100s;
+        // a changes on every visit, b never does
+        EXPECT_TRUE(scheduler.record_visit(page_a, "a" + std::to_string(visit), now));
+        EXPECT_FALSE(scheduler.record_visit(page_b, "b", now));
+    }
+    EXPECT_GT(scheduler.change_rate(page_a), 0);
+    EXPECT_EQ(scheduler.change_rate(page_b), 0);
+    // a is due well before b, and each page is due once
+    Opt_page_path_t next = scheduler.pop_due(now + 60s);
+    ASSERT_TRUE(next);
+    EXPECT_EQ(next->page, "a.html");
+    EXPECT_FALSE(scheduler.pop_due(now + 1000s));
+    next = scheduler.pop_due(now + 10000s);
+    ASSERT_TRUE(next);
+    EXPECT_EQ(next->page, "b.html");
+    EXPECT_FALSE(scheduler.has_due(now + 100000s));
+    // A failed read keeps the page's schedule
+    scheduler.record_failure(page_b, now);
+    EXPECT_TRUE(scheduler.pop_due(now + 10000s));
+    Revisit_stats stats = scheduler.stats();
+    EXPECT_EQ(stats.num_pages, 2u);
+    EXPECT_EQ(stats.num_visits, 12u);
+    EXPECT_EQ(stats.num_changed, 5u);
+    EXPECT_EQ(stats.num_unchanged, 5u);
+}
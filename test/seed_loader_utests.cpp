@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <seed_loader.h>
+#include <url_mgr.h>
+
+static std::string seed_path(const char* name) {
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+static void write_file(const std::string& file_path, const std::string& content) {
+    std::ofstream out(file_path, std::ios::trunc);
+    out << content;
+}
+
+TEST(Seed_loader, Loads_Site_Urls_In_File_Order) {
+    std::string file_path = seed_path("seed_loader_utests.txt");
+    std::string content = "# Seeds\n"
+        "http://example.com/docs/a.html\r\n"
+        "\n"
+        "  http://EXAMPLE.com/docs/b.html?utm_source=x  \n"
+        "http://other.com/docs/c.html\n"
+        "not a url\n"
+        "http://example.com/docs/a.html\n";
+    for (int i = 0; i < 1000; ++i) {
+        content += "http://example.com/docs/p" + std::to_string(i % 500) + ".html\n";
+    }
+    // The last line has no line end
+    content += "http://example.com/docs/last.html";
+    write_file(file_path, content);
+    Url_mgr url_mgr(Url_mgr::deconstruct_url("http://example.com/docs/"));
+    for (int num_threads: {1, 4, 7}) {
+        Seed_loader loader(num_threads);
+        ASSERT_TRUE(loader.open(file_path));
+        Page_paths_t paths = loader.load([&url_mgr](const Url_t& url) {
+            return url_mgr.make_seed_path(url);
+        });
+        const Seed_load_stats& stats = loader.stats();
+        EXPECT_EQ(stats.num_urls, 1006u);
+        EXPECT_EQ(stats.num_rejected, 2u);
+        EXPECT_EQ(stats.num_duplicates, 501u);
+        ASSERT_EQ(paths.size(), 503u);
+        EXPECT_EQ(stats.num_seeds, paths.size());
+        EXPECT_EQ(paths[0].page, "a.html");
+        EXPECT_EQ(paths[0].depth, 1);
+        EXPECT_EQ(paths[1].page, "b.html");
+        EXPECT_EQ(paths[1].query, "");
+        EXPECT_EQ(paths[2].page, "p0.html");
+        EXPECT_EQ(paths[501].page, "p499.html");
+        EXPECT_EQ(paths[502].page, "last.html");
+    }
+    std::filesystem::remove(file_path);
+}
+
+TEST(Seed_loader, Reports_Missing_File) {
+    Seed_loader loader(2);
+    EXPECT_FALSE(loader.open(seed_path("seed_loader_utests_missing.txt")));
+    std::string file_path = seed_path("seed_loader_utests_empty.txt");
+    write_file(file_path, "");
+    ASSERT_TRUE(loader.open(file_path));
+    EXPECT_TRUE(loader.load([](const Url_t&) { return Opt_page_path_t{}; }).empty());
+    std::filesystem::remove(file_path);
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <site_stats.h>
+
+TEST(Site_stats_processor, Merges_Backlinks_And_Sizes) {
+    std::ostringstream log;
+    Site_stats_processor stats(&log, 1);
+    Page_paths_t a_links{{"/", "b.html", 2}, {"/", "b.html", 2}, {"/", "c.html", 2}};
+    Page_paths_t b_links{{"/", "c.html", 3}};
+    // b.html is linked to by a.html before it is processed
+    stats.process_body_chunk("http://x.com/a.html", 0, "12345");
+    stats.process_body_chunk("http://x.com/a.html", 5, "678");
+    stats.process_page_content("http://x.com/a.html", "http://x.com", 200, 1, a_links, "");
+    std::thread([&] {
+        stats.process_body_chunk("http://x.com/b.html", 0, "1234");
+        stats.process_page_content("http://x.com/b.html", "http://x.com", 200, 2, b_links, "");
+    }).join();
+    stats.process_page_content("http://x.com/c.html", "http://x.com", 404, 2, {}, "");
+    stats.final();
+
+    std::vector<Site_page_stats> pages = stats.snapshot();
+    ASSERT_EQ(pages.size(), 3u);
+    EXPECT_EQ(pages[0].url, "http://x.com/a.html");
+    EXPECT_EQ(pages[0].size, 8u);
+    EXPECT_EQ(pages[0].num_links, 3);
+    EXPECT_EQ(pages[0].num_backlinks, 0);
+    EXPECT_EQ(pages[1].size, 4u);
+    EXPECT_EQ(pages[1].num_backlinks, 2);
+    EXPECT_EQ(pages[2].http_code, 404);
+    EXPECT_EQ(pages[2].num_backlinks, 2);
+    EXPECT_EQ(stats.totals().num_pages, 3u);
+    EXPECT_EQ(stats.totals().num_ok_pages, 2u);
+    EXPECT_EQ(stats.totals().num_bytes, 12u);
+    EXPECT_EQ(stats.totals().num_links, 4u);
+    // Every page's line was written by the flusher thread
+    EXPECT_NE(log.str().find("http://x.com/b.html HTTP code 200 has 4 bytes"), std::string::npos);
+    EXPECT_NE(log.str().find("http://x.com/c.html HTTP code 404"), std::string::npos);
+}
+
+TEST(Site_stats_processor, Counts_Pages_From_Many_Threads) {
+    constexpr const int num_threads{8};
+    constexpr const int num_pages_per_thread{1000};
+    std::ostringstream log;
+    Site_stats_processor stats(&log, 4096);
+    Memory_accountant memory;
+    stats.set_memory_accountant(&memory);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&stats, t] {
+            for (int i = 0; i < num_pages_per_thread; ++i) {
+                // Every page links to the hub
+                Page_paths_t links{{"/", "hub.html", 2}};
+                stats.process_page_content("http://x.com/t" + std::to_string(t) + "p" + 
+                    std::to_string(i) + ".html", "http://x.com", 200, 2, links, "");
+            }
+        });
+    }
+    for (std::thread& thread: threads) {
+        thread.join();
+    }
+    stats.process_page_content("http://x.com/hub.html", "http://x.com", 200, 1, {}, "");
+    stats.final();
+
+    EXPECT_EQ(stats.snapshot().size(), static_cast<size_t>(num_threads * num_pages_per_thread + 1));
+    EXPECT_EQ(stats.totals().num_links, static_cast<size_t>(num_threads * num_pages_per_thread));
+    std::istringstream lines(log.str());
+    size_t num_lines = 0;
+    for (std::string line; std::getline(lines, line); ) {
+        ++num_lines;
+    }
+    EXPECT_EQ(num_lines, static_cast<size_t>(num_threads * num_pages_per_thread + 1));
+    // The log batches were charged until they were written
+    EXPECT_GT(memory.stats().peak_bytes, 0u);
+    EXPECT_EQ(memory.current_bytes(memory_processor_work), 0u);
+    std::ostringstream report;
+    stats.print_site_info(report);
+    EXPECT_NE(report.str().find("Page: http://x.com/hub.html, code: 200, size: 0, depth: 1, "
+        "links: 0, backlinks: 8000"), std::string::npos);
+}
@@ -4,7 +4,9 @@
 #include <chrono>
 #include <atomic>
 #include <forward_list>
+#include <functional>
 #include <thread_pool.h>
+#include <cpu_topology.h>
 
 constexpr const int thread_fcn_count_limit{100};
 constexpr const int thread_fcn_max_ms_sleep{100};
@@ -107,3 +109,73 @@ TEST(Thread_pool, Iterator_Test) {
     }
 }
 
+
+TEST(Cpu_topology, Parses_Cpu_Lists) {
+    EXPECT_EQ(Cpu_topology::parse_cpu_list("0-3,8,10-11"), 
+        (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_EQ(Cpu_topology::parse_cpu_list("5"), std::vector<int>{5});
+    EXPECT_TRUE(Cpu_topology::parse_cpu_list("").empty());
+}
+
+// 2 sockets, each its own NUMA node with 2 cores of 2 hardware threads.
+// Linux numbers the first hardware thread of every core before the second ones.
+static Cpu_topology two_socket_topology() {
+    return Cpu_topology({
+        {0, 0, 0, 0}, {1, 1, 0, 0}, {2, 0, 1, 1}, {3, 1, 1, 1},
+        {4, 0, 0, 0}, {5, 1, 0, 0}, {6, 0, 1, 1}, {7, 1, 1, 1}});
+}
+
+TEST(Cpu_topology, Placement_Orders) {
+    Cpu_topology topology = two_socket_topology();
+    EXPECT_EQ(topology.summary(), "2 sockets, 4 cores, 8 CPUs, 2 NUMA nodes");
+    EXPECT_EQ(topology.placement_cpus(Thread_placement{placement_compact}),
+        (std::vector<int>{0, 4, 1, 5, 2, 6, 3, 7}));
+    EXPECT_EQ(topology.placement_cpus(Thread_placement{placement_scatter}),
+        (std::vector<int>{0, 2, 1, 3, 4, 6, 5, 7}));
+    EXPECT_EQ(topology.placement_cpus(Thread_placement{placement_explicit, {3, 1}}),
+        (std::vector<int>{3, 1}));
+    EXPECT_TRUE(topology.placement_cpus(Thread_placement{}).empty());
+    EXPECT_EQ(topology.numa_node(6), 1);
+}
+
+TEST(Thread_pool, Pins_Threads_To_Cpus) {
+    // Under taskset or a cpuset only some of the online CPUs can be used
+    cpu_set_t allowed_cpus;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus), 0);
+    int cpu = -1;
+    for (int i = 0; i < CPU_SETSIZE; ++i) {
+        if (CPU_ISSET(i, &allowed_cpus)) {
+            cpu = i;
+        }
+    }
+    ASSERT_GE(cpu, 0);
+    Thread_pool tp;
+    tp.set_cpus({cpu});
+    std::atomic_int num_on_cpu{0};
+    std::vector<std::function<bool()>> fcns(4, [&num_on_cpu, cpu]() {
+        num_on_cpu += sched_getcpu() == cpu;
+        return false;
+    });
+    tp.run(fcns.begin(), fcns.end());
+    EXPECT_EQ(num_on_cpu, 4);
+    EXPECT_EQ(tp.num_pin_failures(), 0);
+}
+
+TEST(Thread_pool, Counts_Threads_That_Cant_Be_Pinned) {
+    cpu_set_t allowed_cpus;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus), 0);
+    if (CPU_ISSET(CPU_SETSIZE - 1, &allowed_cpus)) {
+        GTEST_SKIP() << "every CPU is allowed";
+    }
+    Thread_pool tp;
+    tp.set_cpus({CPU_SETSIZE - 1});
+    std::atomic_int num_calls{0};
+    std::vector<std::function<bool()>> fcns(3, [&num_calls]() {
+        ++num_calls;
+        return false;
+    });
+    tp.run(fcns.begin(), fcns.end());
+    // The threads still run, unpinned
+    EXPECT_EQ(num_calls, 3);
+    EXPECT_EQ(tp.num_pin_failures(), 3);
+}
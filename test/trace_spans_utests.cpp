@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <optional>
+#include <trace_spans.h>
+
+TEST(Trace_spans, Records_Only_When_Enabled) {
+    Tracer tracer;
+    { Trace_span span{"off", tracer}; }
+    EXPECT_EQ(tracer.num_events(), 0u);
+    tracer.enable();
+    {
+        Trace_span outer{"outer", tracer};
+        Trace_span inner{"inner", tracer};
+    }
+    tracer.disable();
+    { Trace_span span{"off_again", tracer}; }
+    EXPECT_EQ(tracer.num_events(), 2u);
+    std::ostringstream out;
+    tracer.write_chrome_json(out);
+    std::string json = out.str();
+    EXPECT_NE(json.find("\"name\":\"outer\",\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"inner\""), std::string::npos);
+    EXPECT_EQ(json.find("off"), std::string::npos);
+}
+
+TEST(Trace_spans, Ring_Keeps_Newest_Events) {
+    Tracer tracer;
+    tracer.enable(4);
+    for (int i = 0; i < 10; ++i) {
+        tracer.record(i < 6 ? "old" : "new", i * 1000, i * 1000 + 1500);
+    }
+    EXPECT_EQ(tracer.num_events(), 4u);
+    std::ostringstream out;
+    tracer.write_chrome_json(out);
+    std::string json = out.str();
+    EXPECT_EQ(json.find("\"old\""), std::string::npos);
+    // The last event starts at 9 us and lasts 1.5 us
+    EXPECT_NE(json.find("\"ts\":9.000,\"dur\":1.500"), std::string::npos);
+}
+
+TEST(Trace_spans, Enable_Starts_A_New_Trace) {
+    Tracer tracer;
+    tracer.enable();
+    tracer.record("first", 0, 1000);
+    std::optional<Trace_span> open_span;
+    open_span.emplace("open", tracer);
+    tracer.disable();
+    tracer.enable();
+    EXPECT_EQ(tracer.num_events(), 0u);
+    // A span begun before the enable still ends after it began
+    open_span.reset();
+    tracer.record("backwards", 2000, 1000);
+    EXPECT_EQ(tracer.num_events(), 2u);
+    std::ostringstream out;
+    tracer.write_chrome_json(out);
+    std::string json = out.str();
+    EXPECT_EQ(json.find("first"), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"open\""), std::string::npos);
+    EXPECT_EQ(json.find('-'), std::string::npos);
+    EXPECT_NE(json.find("\"ts\":2.000,\"dur\":0.000"), std::string::npos);
+}
+
+TEST(Trace_spans, Each_Thread_Has_A_Track) {
+    Tracer tracer;
+    tracer.enable();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&tracer] {
+            for (int j = 0; j < 100; ++j) {
+                Trace_span span{"work", tracer};
+            }
+        });
+    }
+    for (std::thread& thread: threads) {
+        thread.join();
+    }
+    EXPECT_EQ(tracer.num_events(), 400u);
+    std::ostringstream out;
+    tracer.write_chrome_json(out);
+    std::string json = out.str();
+    size_t num_tracks = 0;
+    for (size_t pos = json.find("thread_name"); pos != std::string::npos; 
+        pos = json.find("thread_name", pos + 1)) {
+        ++num_tracks;
+    }
+    EXPECT_EQ(num_tracks, 4u);
+}
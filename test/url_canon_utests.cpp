@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <url_canon.h>
+#include <url_mgr.h>
+
+TEST(Url_canon, Removes_Dot_Segments) {
+    EXPECT_EQ(Url_canonicalizer::remove_dot_segments("/a/b/c/./../../g"), "/a/g");
+    EXPECT_EQ(Url_canonicalizer::remove_dot_segments("/docs/./guide/"), "/docs/guide/");
+    EXPECT_EQ(Url_canonicalizer::remove_dot_segments("/docs/sub/../"), "/docs/");
+    EXPECT_EQ(Url_canonicalizer::remove_dot_segments("/../../a/"), "/a/");
+    EXPECT_EQ(Url_canonicalizer::remove_dot_segments("/docs/.."), "/");
+}
+
+TEST(Url_canon, Normalizes_Percent_Encoding) {
+    EXPECT_EQ(Url_canonicalizer::normalize_percent_encoding("/%7euser/%61b"), "/~user/ab");
+    EXPECT_EQ(Url_canonicalizer::normalize_percent_encoding("/a%2fb%3A"), "/a%2Fb%3A");
+    EXPECT_EQ(Url_canonicalizer::normalize_percent_encoding("/100%"), "/100%");
+}
+
+TEST(Url_canon, Canonical_Domain) {
+    EXPECT_EQ(Url_canonicalizer::canonical_domain("HTTP://Example.COM:80"), "http://example.com");
+    EXPECT_EQ(Url_canonicalizer::canonical_domain("https://example.com:443"), "https://example.com");
+    EXPECT_EQ(Url_canonicalizer::canonical_domain("http://example.com:8080"), "http://example.com:8080");
+}
+
+TEST(Url_canon, Query_Rules) {
+    Url_canonicalizer keep_all;
+    EXPECT_EQ(keep_all.canonical_query("b=2&utm_source=x&a=1&fbclid=y"), "a=1&b=2");
+    EXPECT_EQ(keep_all.canonical_query(""), "");
+
+    Url_canon_rules whitelist_rules;
+    whitelist_rules.query_mode = query_whitelist;
+    whitelist_rules.whitelist_params = {"page", "lang*"};
+    Url_canonicalizer whitelist(whitelist_rules);
+    EXPECT_EQ(whitelist.canonical_query("sort=asc&page=2&language=en"), "language=en&page=2");
+
+    Url_canon_rules strip_rules;
+    strip_rules.query_mode = query_strip_all;
+    EXPECT_EQ(Url_canonicalizer(strip_rules).canonical_query("page=2"), "");
+}
+
+TEST(Url_canon, Dedup_Key_Matches_Variants) {
+    Url_canonicalizer canon;
+    Url_t key = canon.dedup_key(Page_path_t{"/docs/", "", 1});
+    EXPECT_EQ(canon.dedup_key(Page_path_t{"/docs", "", 1}), key);
+    EXPECT_EQ(canon.dedup_key(Page_path_t{"/docs/", "index.html", 1}), key);
+    EXPECT_EQ(canon.dedup_key(Page_path_t{"/docs/", "Index.HTM", 1}), key);
+    EXPECT_NE(canon.dedup_key(Page_path_t{"/docs/", "guide.html", 1}), key);
+    EXPECT_NE(canon.dedup_key(Page_path_t{"/docs/", "", 1, "page=2"}), key);
+}
+
+static Opt_page_path_t child_path(const Url_mgr& url_mgr, const Url_t& link,
+    const Page_path_t& parent) {
+    Page_paths_t paths = url_mgr.extract_child_page_paths("<a href=\"" + link + "\">", parent);
+    return paths.empty() ? Opt_page_path_t{} : Opt_page_path_t{paths.front()};
+}
+
+TEST(Url_canon, Child_Links_Are_Canonicalized) {
+    Url_mgr url_mgr(Url_mgr::deconstruct_url("HTTP://Example.com:80/docs/"));
+    EXPECT_EQ(url_mgr.site_domain(), "http://example.com");
+    Page_path_t parent{"/docs/sub/", "page.html", 1};
+    Opt_page_path_t child = child_path(url_mgr,
+        "../guide/./intro.html?utm_source=x&amp;b=2&amp;a=1", parent);
+    ASSERT_TRUE(child);
+    EXPECT_EQ(child->path, "/docs/guide/");
+    EXPECT_EQ(child->page, "intro.html");
+    EXPECT_EQ(child->query, "a=1&b=2");
+    EXPECT_EQ(child->depth, 2);
+    EXPECT_TRUE(child_path(url_mgr, "http://EXAMPLE.com/docs/a.html", parent));
+    EXPECT_FALSE(child_path(url_mgr, "../../other/a.html", parent));
+    Opt_page_path_t query_only = child_path(url_mgr, "?page=3", parent);
+    ASSERT_TRUE(query_only);
+    EXPECT_EQ(query_only->page, "page.html");
+    EXPECT_EQ(query_only->query, "page=3");
+}
+
+TEST(Url_canon, Url_Mgr_Dedups_Variants) {
+    Url_mgr url_mgr(Url_mgr::deconstruct_url("http://example.com/docs/"));
+    url_mgr.update_page_paths(Page_paths_t{
+        Page_path_t{"/docs", "", 2}, Page_path_t{"/docs/", "index.html", 2},
+        Page_path_t{"/docs/", "a.html", 2, "x=1"}, Page_path_t{"/docs/", "a.html", 2, "x=1"}});
+    // The site page plus a.html?x=1
+    EXPECT_EQ(url_mgr.num_new_paths(), 2);
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <filesystem>
+#include <url_frontier.h>
+#include <url_mgr.h>
+
+static Page_path_t make_path(int i) {
+    return Page_path_t{"/docs/section" + std::to_string(i % 7) + "/", 
+        "page" + std::to_string(i) + ".html", i % 5 + 1};
+}
+
+TEST(Url_frontier, Unlimited_Stays_In_Memory) {
+    Url_frontier frontier;
+    for (int i = 0; i < 1000; ++i) {
+        frontier.push(make_path(i));
+    }
+    EXPECT_EQ(frontier.size(), 1000u);
+    EXPECT_EQ(frontier.num_spilled(), 0u);
+    for (int i = 0; i < 1000; ++i) {
+        Opt_page_path_t path = frontier.pop();
+        ASSERT_TRUE(path);
+        EXPECT_EQ(path->page, make_path(i).page);
+    }
+    EXPECT_FALSE(frontier.pop());
+}
+
+TEST(Url_frontier, Spills_Above_Budget_And_Keeps_Fifo_Order) {
+    constexpr const size_t budget{16 * 1024};
+    constexpr const int num_paths{20000};
+    Url_frontier frontier(Frontier_config{budget, "", 4 * 1024});
+    int next_pop = 0;
+    for (int i = 0; i < num_paths; ++i) {
+        frontier.push(make_path(i));
+        // Interleave pops with the pushes, like a crawl does
+        if (i % 3 == 0) {
+            Opt_page_path_t path = frontier.pop();
+            ASSERT_TRUE(path);
+            ASSERT_EQ(path->page, make_path(next_pop).page);
+            EXPECT_EQ(path->depth, make_path(next_pop).depth);
+            ++next_pop;
+        }
+        ASSERT_LE(frontier.memory_bytes(), budget + 2 * 4 * 1024);
+    }
+    EXPECT_GT(frontier.num_spilled(), 0u);
+    EXPECT_EQ(frontier.size(), static_cast<size_t>(num_paths - next_pop));
+    while (Opt_page_path_t path = frontier.pop()) {
+        ASSERT_EQ(path->path, make_path(next_pop).path);
+        ASSERT_EQ(path->page, make_path(next_pop).page);
+        ++next_pop;
+    }
+    EXPECT_EQ(next_pop, num_paths);
+    EXPECT_EQ(frontier.num_spilled(), 0u);
+}
+
+TEST(Url_frontier, Removes_Segments_When_Destroyed) {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "url_frontier_utests";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    {
+        Url_frontier frontier(Frontier_config{1024, dir.string(), 256});
+        for (int i = 0; i < 2000; ++i) {
+            frontier.push(make_path(i));
+        }
+        // Pop into the spilled paths, so a segment is being read back
+        for (int i = 0; i < 100; ++i) {
+            Opt_page_path_t path = frontier.pop();
+            ASSERT_TRUE(path);
+            ASSERT_EQ(path->page, make_path(i).page);
+        }
+        EXPECT_GT(frontier.num_spilled(), 0u);
+    }
+    EXPECT_TRUE(std::filesystem::is_empty(dir));
+    std::filesystem::remove_all(dir);
+}
+
+TEST(Url_mgr, Shards_Frontier_Per_Numa_Node) {
+    // This machine's CPUs are on node 0, and a second node has a CPU that isn't online
+    std::vector<Cpu_info> cpus = Cpu_topology::detect().cpus();
+    for (Cpu_info& info: cpus) {
+        info.numa_node = 0;
+    }
+    cpus.push_back(Cpu_info{cpus.back().cpu + 1, cpus.back().core + 1, 0, 1});
+    Url_mgr_config config;
+    config.numa_topology = Cpu_topology(cpus);
+    Url_mgr url_mgr(Url_mgr::deconstruct_url("http://example.com/docs/"), false, config);
+    ASSERT_EQ(url_mgr.num_frontier_shards(), 2);
+    // Seeds are dealt out to both shards
+    Page_paths_t seeds;
+    for (int i = 0; i < 10; ++i) {
+        seeds.push_back(Page_path_t{"/docs/", "seed" + std::to_string(i) + ".html", 1});
+    }
+    url_mgr.add_seed_paths(seeds);
+    // A crawling thread's paths go to its own node's shard
+    url_mgr.update_page_paths(Page_paths_t{Page_path_t{"/docs/", "child.html", 2}});
+    EXPECT_EQ(url_mgr.num_new_paths(), 11);
+    std::vector<std::string> pages;
+    while (Opt_page_path_t path = url_mgr.pop_new_path()) {
+        pages.push_back(path->page);
+    }
+    // Node 0's paths come first, then the other node's are taken
+    std::vector<std::string> expected_pages{"seed0.html", "seed2.html", "seed4.html", 
+        "seed6.html", "seed8.html", "child.html", "seed1.html", "seed3.html", "seed5.html",
+        "seed7.html", "seed9.html"};
+    EXPECT_EQ(pages, expected_pages);
+    EXPECT_EQ(url_mgr.num_new_paths(), 0);
+}
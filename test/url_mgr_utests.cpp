@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <url_mgr.h>
+
+static Opt_page_path_t child_path(const Url_mgr& url_mgr, const Url_t& link,
+    const Page_path_t& parent) {
+    Page_paths_t paths = url_mgr.extract_child_page_paths("<a href=\"" + link + "\">", parent);
+    return paths.empty() ? Opt_page_path_t{} : Opt_page_path_t{paths.front()};
+}
+
+TEST(Url_mgr, Deconstructs_Urls) {
+    Deconstructed_url durl = Url_mgr::deconstruct_url("http://example.com/docs/guide.html?a=1");
+    EXPECT_EQ(durl.domain, "http://example.com");
+    EXPECT_EQ(durl.path, "/docs/");
+    EXPECT_EQ(durl.page, "guide.html");
+    EXPECT_EQ(durl.query, "a=1");
+    // Without an extension the last segment is part of the path
+    durl = Url_mgr::deconstruct_url("https://example.com:8443/docs/guide");
+    EXPECT_EQ(durl.domain, "https://example.com:8443");
+    EXPECT_EQ(durl.path, "/docs/guide");
+    EXPECT_TRUE(durl.page.empty());
+    // Any extension, including a compound one, makes a page
+    durl = Url_mgr::deconstruct_url("../files/release-1.tar.gz", true);
+    EXPECT_EQ(durl.path, "../files/");
+    EXPECT_EQ(durl.page, "release-1.tar.gz");
+    EXPECT_TRUE(Url_mgr::deconstruct_url("/docs/a.html", false).path.empty());
+    EXPECT_TRUE(Url_mgr::deconstruct_url("ftp://example.com/a.html").domain.empty());
+}
+
+TEST(Url_mgr, Drops_Fragments) {
+    Deconstructed_url durl = Url_mgr::deconstruct_url("http://example.com/docs/a.html?x=1#intro");
+    EXPECT_EQ(durl.path, "/docs/");
+    EXPECT_EQ(durl.page, "a.html");
+    EXPECT_EQ(durl.query, "x=1");
+    Url_mgr url_mgr(Url_mgr::deconstruct_url("http://example.com/docs/"));
+    Opt_page_path_t seed_path = url_mgr.make_seed_path("http://example.com/docs/a.html#intro");
+    ASSERT_TRUE(seed_path);
+    EXPECT_EQ(seed_path->path, "/docs/");
+    EXPECT_EQ(seed_path->page, "a.html");
+    EXPECT_EQ(seed_path->depth, 1);
+    Opt_page_path_t relative_seed = url_mgr.make_seed_path("guide/#top");
+    ASSERT_TRUE(relative_seed);
+    EXPECT_EQ(relative_seed->path, "/docs/guide/");
+    // A fragment alone is the page it's on
+    EXPECT_FALSE(url_mgr.make_seed_path("#top"));
+}
+
+TEST(Url_mgr, Skips_Non_Html_Extensions) {
+    Url_mgr url_mgr(Url_mgr::deconstruct_url("http://example.com/docs/"));
+    Page_path_t parent{"/docs/", "", 1};
+    EXPECT_FALSE(child_path(url_mgr, "manual.pdf", parent));
+    EXPECT_FALSE(child_path(url_mgr, "images/Logo.PNG", parent));
+    EXPECT_FALSE(child_path(url_mgr, "release-1.tar.gz", parent));
+    // Pages with other extensions are crawled, their Content-Type decides
+    Opt_page_path_t php_page = child_path(url_mgr, "list.php?id=2", parent);
+    ASSERT_TRUE(php_page);
+    EXPECT_EQ(php_page->page, "list.php");
+    EXPECT_EQ(php_page->query, "id=2");
+    EXPECT_TRUE(child_path(url_mgr, "a.html", parent));
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <regex>
+#include <url_rules.h>
+#include <url_mgr.h>
+
+static bool allows(const Url_rules& rules, const Url_t& page_path) {
+    Deconstructed_url durl = Url_mgr::deconstruct_url(page_path, true);
+    return rules.allows(Page_path_t{durl.path, durl.page, 1, durl.query});
+}
+
+TEST(Url_rules, Glob_Patterns) {
+    Url_rules rules(Url_rules_config{{"/docs/**"}, {"**/calendar/**", "/docs/*.php", "/docs/v[0-9]/**"}});
+    ASSERT_TRUE(rules.is_valid());
+    EXPECT_TRUE(allows(rules, "/docs/guide/a.html"));
+    EXPECT_TRUE(allows(rules, "/docs/list.php5"));
+    EXPECT_FALSE(allows(rules, "/blog/a.html"));
+    EXPECT_FALSE(allows(rules, "/docs/events/calendar/2024/01"));
+    // * stays in its path segment
+    EXPECT_FALSE(allows(rules, "/docs/list.php"));
+    EXPECT_TRUE(allows(rules, "/docs/sub/list.php"));
+    EXPECT_FALSE(allows(rules, "/docs/v2/a.html"));
+    EXPECT_TRUE(allows(rules, "/docs/vx/a.html"));
+}
+
+TEST(Url_rules, Regex_Patterns) {
+    Url_rules rules(Url_rules_config{{}, {"re:[?&](sort|filter)=", "re:^/p/\\d+$"}});
+    ASSERT_TRUE(rules.is_valid());
+    EXPECT_TRUE(allows(rules, "/shop/list.html?page=2"));
+    EXPECT_FALSE(allows(rules, "/shop/list.html?page=2&sort=price"));
+    EXPECT_FALSE(allows(rules, "/shop/list.html?filter=red"));
+    EXPECT_FALSE(allows(rules, "/p/123"));
+    EXPECT_TRUE(allows(rules, "/p/123/reviews"));
+}
+
+TEST(Url_rules, Path_Depth_And_Query_Limits) {
+    Url_rules_config config;
+    config.max_path_depth = 2;
+    config.max_query_params = 1;
+    Url_rules rules(config);
+    EXPECT_TRUE(allows(rules, "/a/b/page.html"));
+    EXPECT_FALSE(allows(rules, "/a/b/c/page.html"));
+    EXPECT_TRUE(allows(rules, "/a/page.html?x=1"));
+    EXPECT_FALSE(allows(rules, "/a/page.html?x=1&y=2"));
+}
+
+TEST(Url_rules, Matches_Like_Std_Regex) {
+    const std::vector<std::string> patterns{"a(b|cd)*e", "^/x[^/]+/?$", "[a-c]+\\.html$",
+        "(ab|a)(bc|c)?d", "\\w+\\?q=", "cde|/x", "^(/a|/x)|html$"};
+    const std::vector<Url_t> paths{"/ae", "/abcdcde", "/xyz/", "/x/y", "/abc.html", 
+        "/d.html", "/abd", "/acd", "/abcd", "/s?q=1", "/?q=1", "/a/b/c"};
+    for (const std::string& pattern: patterns) {
+        Url_rules rules(Url_rules_config{{"re:" + pattern}});
+        ASSERT_TRUE(rules.is_valid()) << pattern;
+        std::regex re(pattern);
+        for (const Url_t& path: paths) {
+            EXPECT_EQ(allows(rules, path), std::regex_search(path, re)) << pattern << " " << path;
+        }
+    }
+}
+
+TEST(Url_rules, Reports_Invalid_Patterns) {
+    EXPECT_FALSE(Url_rules(Url_rules_config{{"re:(ab"}}).is_valid());
+    EXPECT_FALSE(Url_rules(Url_rules_config{{}, {"re:*a"}}).is_valid());
+    EXPECT_FALSE(Url_rules(Url_rules_config{{"re:[ab"}}).is_valid());
+    EXPECT_FALSE(Url_rules(Url_rules_config{{"re:a^b"}}).is_valid());
+    // An invalid rule set only applies the limits
+    Url_rules rules(Url_rules_config{{"re:a)"}, {}, 1});
+    EXPECT_TRUE(allows(rules, "/a/page.html"));
+    EXPECT_FALSE(allows(rules, "/a/b/page.html"));
+}
+
+TEST(Url_rules, Filters_Links_Before_The_Frontier) {
+    Url_mgr_config config;
+    config.rules.exclude_patterns = {"**/calendar/**"};
+    Url_mgr url_mgr(Url_mgr::deconstruct_url("http://example.com/"), false, config);
+    Page_paths_t paths = url_mgr.extract_child_page_paths(
+        "<a href=\"/calendar/2024/01/\">Jan</a><a href=\"/about.html\">About</a>", 
+        Page_path_t{"/", "", 1});
+    ASSERT_EQ(paths.size(), 1u);
+    EXPECT_EQ(paths[0].page, "about.html");
+}
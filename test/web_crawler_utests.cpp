@@ -0,0 +1,413 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <filesystem>
+#include <web_crawler.h>
+
+// Serves an in-memory site. Each page links to its two children, like a binary tree.
+class Mock_site_reader {
+public:
+    Mock_site_reader(int num_pages, int num_failures_per_page = 0,
+        std::chrono::milliseconds read_delay = std::chrono::milliseconds(0)) : 
+        num_pages_(num_pages), num_failures_per_page_(num_failures_per_page),
+        read_delay_(read_delay) {}
+
+    Read_Results_t read_page(const Url_t& url, const Read_options& options) {
+        int num_concurrent = ++num_concurrent_reads_;
+        int max_concurrent = max_concurrent_reads_;
+        while (num_concurrent > max_concurrent and
+            !max_concurrent_reads_.compare_exchange_weak(max_concurrent, num_concurrent)) {}
+        Read_Results_t results = read_site_page(url, options);
+        --num_concurrent_reads_;
+        return results;
+    }
+    int num_reads() const {
+        return num_reads_;
+    }
+    int max_concurrent_reads() const {
+        return max_concurrent_reads_;
+    }
+
+private:
+    const int num_pages_;
+    const int num_failures_per_page_;
+    const std::chrono::milliseconds read_delay_;
+    std::mutex mutex_;
+    std::map<Url_t, int> read_counts_;
+    int num_reads_{0};
+    std::atomic_int num_concurrent_reads_{0};
+    std::atomic_int max_concurrent_reads_{0};
+
+    Read_Results_t read_site_page(const Url_t& url, const Read_options& options) {
+        // A slow transfer that can be cancelled, like libcurl's progress callback
+        auto end_time = std::chrono::steady_clock::now() + read_delay_;
+        while (std::chrono::steady_clock::now() < end_time) {
+            if (options.cancel_ptr and options.cancel_ptr->is_cancelled()) {
+                return Read_Results_t{http_request_cancelled, ""};
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::lock_guard lock(mutex_);
+        ++num_reads_;
+        if (read_counts_[url]++ < num_failures_per_page_) {
+            return Read_Results_t{http_service_unavailable, ""};
+        }
+        size_t page_pos = url.rfind("/p");
+        int page_num = page_pos == std::string::npos ? 0 : std::stoi(url.substr(page_pos + 2));
+        if (page_num >= num_pages_) {
+            return Read_Results_t{http_not_found, ""};
+        }
+        std::string content;
+        for (int child: {2 * page_num + 1, 2 * page_num + 2}) {
+            content += "<a href=\"p" + std::to_string(child) + ".html\">child</a>";
+        }
+        Read_Results_t results{http_ok, content, content.size()};
+        if (options.keep_headers) {
+            results.headers = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n";
+        }
+        return results;
+    }
+};
+
+// A concrete processor, so the crawler calls it without virtual dispatch
+class Collecting_processor {
+public:
+    void process_page_content(const Url_t& page_url, const Url_t&, int http_code, int depth,
+        const Page_paths_t&, const Page_content_t&) {
+        std::lock_guard lock(mutex_);
+        pages_[page_url] = http_code;
+        max_depth_ = std::max(max_depth_, depth);
+    }
+    void final() {
+        is_final_ = true;
+    }
+    std::map<Url_t, int> pages_;
+    int max_depth_{0};
+    bool is_final_{false};
+
+private:
+    std::mutex mutex_;
+};
+
+using Mock_crawler = Basic_web_crawler<Mock_site_reader, Url_mgr, Collecting_processor>;
+
+// Only counts the content streamed to it, so the crawler keeps neither links nor content
+class Streaming_processor {
+public:
+    unsigned needs() const {
+        return processor_needs_body_stream;
+    }
+    void process_body_chunk(const Url_t&, size_t, Page_content_t chunk) {
+        num_streamed_bytes_ += chunk.size();
+    }
+    void process_page_content(const Url_t&, const Url_t&, int http_code, int,
+        const Page_paths_t& paths, const Page_content_t& content) {
+        num_ok_pages_ += http_code == http_ok;
+        num_links_ += paths.size();
+        num_content_bytes_ += content.size();
+    }
+    void final() {}
+    std::atomic<size_t> num_streamed_bytes_{0};
+    std::atomic<size_t> num_ok_pages_{0};
+    std::atomic<size_t> num_links_{0};
+    std::atomic<size_t> num_content_bytes_{0};
+};
+
+// Counts the pages whose headers it got, before their content
+class Headers_processor {
+public:
+    unsigned needs() const {
+        return processor_needs_response_headers;
+    }
+    void process_response_headers(const Url_t& page_url, std::string_view headers) {
+        std::lock_guard lock(mutex_);
+        page_headers_[page_url] = headers;
+    }
+    void process_page_content(const Url_t& page_url, const Url_t&, int http_code, int,
+        const Page_paths_t&, const Page_content_t&) {
+        std::lock_guard lock(mutex_);
+        num_ok_pages_with_headers_ += http_code == http_ok and 
+            page_headers_[page_url].rfind("HTTP/1.1 200 OK\r\n", 0) == 0;
+    }
+    void final() {}
+    int num_ok_pages_with_headers_{0};
+
+private:
+    std::mutex mutex_;
+    std::map<Url_t, std::string> page_headers_;
+};
+
+TEST(Web_crawler, Crawls_In_Memory_Site) {
+    Mock_crawler crawler(4, Mock_crawler::unlimited_depth, 100);
+    Collecting_processor processor;
+    Crawl_result_t result = crawler.crawl("http://example.com/site/", &processor);
+    ASSERT_TRUE(static_cast<bool>(result));
+    EXPECT_TRUE(processor.is_final_);
+    // The site page, p1 to p99, and the 404s linked from the last level
+    int num_ok = 0;
+    for (const auto& [url, http_code]: processor.pages_) {
+        num_ok += http_code == http_ok;
+    }
+    EXPECT_EQ(num_ok, 100);
+    EXPECT_EQ(crawler.reader().num_reads(), static_cast<int>(processor.pages_.size()));
+}
+
+TEST(Web_crawler, Stops_At_Max_Depth) {
+    Mock_crawler crawler(3, 3, 1000);
+    Collecting_processor processor;
+    Crawl_result_t result = crawler.crawl("http://example.com/site/", &processor);
+    ASSERT_TRUE(static_cast<bool>(result));
+    // Depth 1 is the site page, then p1 and p2, then p3 to p6
+    EXPECT_EQ(processor.pages_.size(), 7u);
+    EXPECT_EQ(processor.max_depth_, 3);
+}
+
+TEST(Web_crawler, Retries_Failed_Pages) {
+    Mock_crawler crawler(4, 3, 1000, 1);
+    Host_health_config config;
+    config.backoff_base_ms = 1;
+    config.breaker_failure_threshold = 1000;
+    crawler.set_host_health_config(config);
+    Collecting_processor processor;
+    Crawl_result_t result = crawler.crawl("http://example.com/site/", &processor);
+    ASSERT_TRUE(static_cast<bool>(result));
+    ASSERT_EQ(processor.pages_.size(), 7u);
+    for (const auto& [url, http_code]: processor.pages_) {
+        EXPECT_EQ(http_code, http_ok) << url;
+    }
+    EXPECT_EQ(crawler.reader().num_reads(), 14);
+}
+
+TEST(Web_crawler, Probes_Host_After_Breaker_Opens) {
+    // Threads that find no page must not keep the probe, or the breaker
+    // stays half open and the crawl never finishes
+    Mock_crawler crawler(4, 3, 1000, 2);
+    Host_health_config config;
+    config.backoff_base_ms = 400;
+    config.breaker_failure_threshold = 1;
+    config.breaker_open_ms = 5;
+    crawler.set_host_health_config(config);
+    Collecting_processor processor;
+    Crawl_result_t result = crawler.crawl("http://example.com/site/", &processor);
+    ASSERT_TRUE(static_cast<bool>(result));
+    ASSERT_EQ(processor.pages_.size(), 7u);
+    for (const auto& [url, http_code]: processor.pages_) {
+        EXPECT_EQ(http_code, http_ok) << url;
+    }
+}
+
+TEST(Web_crawler, Rejects_Invalid_Url) {
+    Mock_crawler crawler(2, 3, 10);
+    Collecting_processor processor;
+    Crawl_result_t result = crawler.crawl("not a url", &processor);
+    ASSERT_FALSE(static_cast<bool>(result));
+    EXPECT_EQ(result.error().err_code, crawl_error_invalid_url);
+}
+
+TEST(Web_crawler, Stops_At_Page_Limit) {
+    Mock_crawler crawler(4, Mock_crawler::unlimited_depth, 1000);
+    crawler.set_budget(Crawl_budget{.max_pages = 10});
+    Collecting_processor processor;
+    Crawl_result_t result = crawler.crawl("http://example.com/site/", &processor);
+    ASSERT_TRUE(static_cast<bool>(result));
+    EXPECT_TRUE(processor.is_final_);
+    EXPECT_EQ(crawler.stop_reason(), crawl_stop_page_limit);
+    // The pages read before the stop are still processed
+    EXPECT_EQ(processor.pages_.size(), 10u);
+    EXPECT_EQ(crawler.reader().num_reads(), 10);
+}
+
+TEST(Web_crawler, Stops_At_Deadline) {
+    Mock_crawler crawler(2, Mock_crawler::unlimited_depth, 100000, 0, 
+        std::chrono::milliseconds(20));
+    crawler.set_budget(Crawl_budget{.max_duration = std::chrono::milliseconds(100)});
+    Collecting_processor processor;
+    auto start_time = std::chrono::steady_clock::now();
+    Crawl_result_t result = crawler.crawl("http://example.com/site/", &processor);
+    auto elapsed = std::chrono::steady_clock::now() - start_time;
+    ASSERT_TRUE(static_cast<bool>(result));
+    EXPECT_TRUE(processor.is_final_);
+    EXPECT_EQ(crawler.stop_reason(), crawl_stop_deadline);
+    EXPECT_GT(processor.pages_.size(), 0u);
+    EXPECT_LT(elapsed, std::chrono::seconds(1));
+}
+
+TEST(Web_crawler, Cancel_Aborts_Reads) {
+    // Without the cancel each read takes 10 seconds
+    Mock_crawler crawler(4, Mock_crawler::unlimited_depth, 1000, 0, 
+        std::chrono::seconds(10));
+    Collecting_processor processor;
+    auto start_time = std::chrono::steady_clock::now();
+    std::thread crawl_thread([&crawler, &processor] {
+        crawler.crawl("http://example.com/site/", &processor);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    crawler.cancel();
+    crawl_thread.join();
+    auto elapsed = std::chrono::steady_clock::now() - start_time;
+    EXPECT_LT(elapsed, std::chrono::seconds(1));
+    EXPECT_TRUE(processor.is_final_);
+    EXPECT_EQ(crawler.stop_reason(), crawl_stop_cancelled);
+    // The aborted reads aren't processed
+    EXPECT_TRUE(processor.pages_.empty());
+}
+
+TEST(Web_crawler, Cancel_Before_Crawl_Is_Kept) {
+    Mock_crawler crawler(4, Mock_crawler::unlimited_depth, 1000, 0, 
+        std::chrono::seconds(10));
+    Collecting_processor processor;
+    // Stands in for a cancel that arrives while crawl() is setting up
+    crawler.cancel();
+    auto start_time = std::chrono::steady_clock::now();
+    Crawl_result_t result = crawler.crawl("http://example.com/site/", &processor);
+    auto elapsed = std::chrono::steady_clock::now() - start_time;
+    ASSERT_TRUE(static_cast<bool>(result));
+    EXPECT_LT(elapsed, std::chrono::seconds(1));
+    EXPECT_TRUE(processor.is_final_);
+    EXPECT_EQ(crawler.stop_reason(), crawl_stop_cancelled);
+    EXPECT_TRUE(processor.pages_.empty());
+    // A cancel made before a crawl only stops that crawl
+    Mock_crawler next_crawler(2, 3, 1000);
+    next_crawler.cancel();
+    next_crawler.crawl("http://example.com/site/", &processor);
+    Collecting_processor next_processor;
+    ASSERT_TRUE(static_cast<bool>(next_crawler.crawl("http://example.com/site/", &next_processor)));
+    EXPECT_EQ(next_crawler.stop_reason(), crawl_stop_completed);
+    EXPECT_EQ(next_processor.pages_.size(), 7u);
+}
+
+TEST(Web_crawler, Reused_Crawler_Starts_Fresh) {
+    Mock_crawler crawler(4, Mock_crawler::unlimited_depth, 1000);
+    Collecting_processor processor;
+    ASSERT_TRUE(static_cast<bool>(crawler.crawl("http://example.com/site/", &processor)));
+    size_t num_bytes = crawler.transfer_stats().decoded_bytes;
+    ASSERT_GT(num_bytes, 0u);
+    // The first crawl's bytes don't count against the second crawl's budget
+    crawler.set_budget(Crawl_budget{.max_bytes = num_bytes + 1});
+    Collecting_processor next_processor;
+    ASSERT_TRUE(static_cast<bool>(crawler.crawl("http://example.com/site/", &next_processor)));
+    EXPECT_EQ(crawler.stop_reason(), crawl_stop_completed);
+    EXPECT_EQ(crawler.transfer_stats().decoded_bytes, num_bytes);
+    EXPECT_EQ(next_processor.pages_.size(), processor.pages_.size());
+}
+
+TEST(Web_crawler, Read_Cancel_Wakes_Waiting_Reads) {
+    Read_cancel cancel;
+    int num_wakeups = 0;
+    int wakeup_id = cancel.add_wakeup([&num_wakeups] { ++num_wakeups; });
+    EXPECT_FALSE(cancel.is_cancelled());
+    cancel.cancel();
+    EXPECT_TRUE(cancel.is_cancelled());
+    EXPECT_EQ(num_wakeups, 1);
+    cancel.remove_wakeup(wakeup_id);
+    cancel.reset();
+    EXPECT_FALSE(cancel.is_cancelled());
+    cancel.cancel();
+    EXPECT_EQ(num_wakeups, 1);
+}
+
+TEST(Web_crawler, Revisits_Pages_Continuously) {
+    // One thread, so new pages are always found before revisits can use up the budget.
+    // With more, a thread can revisit pages while another is still adding their links.
+    Mock_crawler crawler(1, 3, 1000);
+    // Revisit each page as soon as possible
+    Revisit_scheduler scheduler(Revisit_config{std::chrono::seconds(0), 
+        std::chrono::seconds(0), std::chrono::seconds(0)});
+    crawler.set_revisit_scheduler(&scheduler);
+    crawler.set_budget(Crawl_budget{.max_pages = 30});
+    Collecting_processor processor;
+    Crawl_result_t result = crawler.crawl("http://example.com/site/", &processor);
+    ASSERT_TRUE(static_cast<bool>(result));
+    EXPECT_EQ(crawler.stop_reason(), crawl_stop_page_limit);
+    EXPECT_EQ(crawler.reader().num_reads(), 30);
+    // The site doesn't change, so only the first visits reach the processor
+    EXPECT_EQ(processor.pages_.size(), 7u);
+    Revisit_stats stats = scheduler.stats();
+    EXPECT_EQ(stats.num_pages, 7u);
+    EXPECT_EQ(stats.num_visits, 30u);
+    EXPECT_EQ(stats.num_changed, 0u);
+}
+
+TEST(Web_crawler, Memory_Budget_Limits_Reads) {
+    Mock_crawler crawler(4, 5, 1000, 0, std::chrono::milliseconds(2));
+    // Room for one read's reservation, not two
+    crawler.set_memory_budget(1500, 1000);
+    Collecting_processor processor;
+    Crawl_result_t result = crawler.crawl("http://example.com/site/", &processor);
+    ASSERT_TRUE(static_cast<bool>(result));
+    EXPECT_EQ(processor.pages_.size(), 31u);
+    EXPECT_EQ(crawler.reader().max_concurrent_reads(), 1);
+    Memory_stats stats = crawler.memory_stats();
+    EXPECT_EQ(stats.current_bytes, 0u);
+    EXPECT_GE(stats.peak_bytes, 1000u);
+    EXPECT_GT(stats.num_paused_fetches, 0u);
+}
+
+TEST(Web_crawler, Starts_From_Seed_File) {
+    std::string file_path = (std::filesystem::temp_directory_path() / 
+        "web_crawler_utests_seeds.txt").string();
+    {
+        std::ofstream out(file_path, std::ios::trunc);
+        out << "http://example.com/site/p10.html\nhttp://example.com/site/p20.html\n"
+            "http://example.com/other/p30.html\n";
+    }
+    // Seeds are at depth 1, so a max depth of 1 crawls only them and the site page
+    Mock_crawler crawler(2, 1, 1000);
+    crawler.set_seed_file(file_path);
+    Collecting_processor processor;
+    Crawl_result_t result = crawler.crawl("http://example.com/site/", &processor);
+    ASSERT_TRUE(static_cast<bool>(result));
+    EXPECT_EQ(processor.pages_.size(), 3u);
+    EXPECT_EQ(processor.pages_.count("http://example.com/site/p20.html"), 1u);
+    EXPECT_EQ(crawler.seed_stats().num_seeds, 2u);
+    EXPECT_EQ(crawler.seed_stats().num_rejected, 1u);
+    std::filesystem::remove(file_path);
+    crawler.set_seed_file(file_path);
+    result = crawler.crawl("http://example.com/site/", &processor);
+    ASSERT_FALSE(static_cast<bool>(result));
+    EXPECT_EQ(result.error().err_code, crawl_error_seed_file);
+}
+
+TEST(Web_crawler, Passes_Only_What_Processor_Needs) {
+    Basic_web_crawler<Mock_site_reader, Url_mgr, Streaming_processor> crawler(
+        4, Mock_crawler::unlimited_depth, 100);
+    Streaming_processor processor;
+    Crawl_result_t result = crawler.crawl("http://example.com/site/", &processor);
+    ASSERT_TRUE(static_cast<bool>(result));
+    // The crawler still follows the links it doesn't pass on
+    EXPECT_EQ(processor.num_ok_pages_, 100u);
+    EXPECT_EQ(processor.num_links_, 0u);
+    EXPECT_EQ(processor.num_content_bytes_, 0u);
+    EXPECT_GT(processor.num_streamed_bytes_, 0u);
+    EXPECT_EQ(processor.num_streamed_bytes_, crawler.transfer_stats().decoded_bytes);
+}
+
+TEST(Web_crawler, Passes_Response_Headers_Before_Content) {
+    Basic_web_crawler<Mock_site_reader, Url_mgr, Headers_processor> crawler(
+        4, Mock_crawler::unlimited_depth, 100);
+    Headers_processor processor;
+    ASSERT_TRUE(static_cast<bool>(crawler.crawl("http://example.com/site/", &processor)));
+    EXPECT_EQ(processor.num_ok_pages_with_headers_, 100);
+}
+
+TEST(Web_page_reader, Content_Type_Decides_Whether_Page_Is_Read) {
+    EXPECT_EQ(content_media_type("Text/HTML; charset=UTF-8"), "text/html");
+    EXPECT_EQ(content_media_type(" text/html ;charset=utf-8"), "text/html");
+    EXPECT_EQ(content_media_type(""), "");
+    EXPECT_EQ(content_type_http_code("text/html"), http_ok);
+    EXPECT_EQ(content_type_http_code("TEXT/HTML; charset=ISO-8859-1"), http_ok);
+    EXPECT_EQ(content_type_http_code("application/xhtml+xml;q=0.9"), http_ok);
+    // Servers often leave the type out, so those pages are read
+    EXPECT_EQ(content_type_http_code(""), http_ok);
+    EXPECT_EQ(content_type_http_code("; charset=utf-8"), http_ok);
+    EXPECT_EQ(content_type_http_code("image/png"), http_unsupported_media_type);
+    EXPECT_EQ(content_type_http_code("application/pdf; name=a.pdf"), http_unsupported_media_type);
+    EXPECT_EQ(content_type_http_code("text/plain"), http_unsupported_media_type);
+    EXPECT_EQ(content_type_http_code("text/html-sandboxed"), http_unsupported_media_type);
+}
@@ -0,0 +1,186 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+#include <url_canon.h>
+#include <algorithm>
+#include <cctype>
+
+static std::string to_lower(std::string str) {
+    std::transform(str.begin(), str.end(), str.begin(),
+        [](unsigned char c) { return std::tolower(c); });
+    return str;
+}
+
+Url_canonicalizer::Url_canonicalizer(const Url_canon_rules& rules) : rules_(rules) {}
+
+Url_t Url_canonicalizer::canonical_domain(const Url_t& domain) {
+    Url_t canon = to_lower(domain);
+    size_t scheme_end = canon.find("://");
+    size_t port_pos = canon.rfind(':');
+    if (scheme_end != std::string::npos and port_pos > scheme_end + 2) {
+        std::string scheme = canon.substr(0, scheme_end);
+        std::string port = canon.substr(port_pos + 1);
+        if ((scheme == "http" and port == "80") or (scheme == "https" and port == "443")) {
+            canon.erase(port_pos);
+        }
+    }
+    return canon;
+}
+
+Url_t Url_canonicalizer::remove_dot_segments(const Url_t& path) {
+    std::string input = path;
+    std::string output;
+    auto remove_last_segment = [&output] {
+        size_t slash_pos = output.rfind('/');
+        output.erase(slash_pos == std::string::npos ? 0 : slash_pos);
+    };
+    while (!input.empty()) {
+        if (input.rfind("../", 0) == 0) {
+            input.erase(0, 3);
+        }
+        else if (input.rfind("./", 0) == 0) {
+            input.erase(0, 2);
+        }
+        else if (input.rfind("/./", 0) == 0) {
+            input.erase(0, 2);
+        }
+        else if (input == "/.") {
+            input = "/";
+        }
+        else if (input.rfind("/../", 0) == 0) {
+            input.erase(0, 3);
+            remove_last_segment();
+        }
+        else if (input == "/..") {
+            input = "/";
+            remove_last_segment();
+        }
+        else if (input == "." or input == "..") {
+            input.clear();
+        }
+        else {
+            size_t seg_end = input.find('/', input.front() == '/' ? 1 : 0);
+            output.append(input, 0, seg_end);
+            input.erase(0, seg_end);
+        }
+    }
+    return output;
+}
+
+static int hex_value(char c) {
+    return std::isdigit(static_cast<unsigned char>(c)) ? c - '0' :
+        std::isxdigit(static_cast<unsigned char>(c)) ? std::tolower(c) - 'a' + 10 : -1;
+}
+
+Url_t Url_canonicalizer::normalize_percent_encoding(const Url_t& str) {
+    static const char hex_digits[] = "0123456789ABCDEF";
+    Url_t normal;
+    normal.reserve(str.size());
+    for (size_t i = 0; i < str.size(); ++i) {
+        int high, low;
+        if (str[i] == '%' and i + 2 < str.size() and
+            (high = hex_value(str[i + 1])) >= 0 and (low = hex_value(str[i + 2])) >= 0) {
+            char c = static_cast<char>(high * 16 + low);
+            // Unreserved characters mean the same encoded or not (RFC 3986 section 2.3)
+            if (std::isalnum(static_cast<unsigned char>(c)) or c == '-' or c == '.' or
+                c == '_' or c == '~') {
+                normal.push_back(c);
+            }
+            else {
+                normal.push_back('%');
+                normal.push_back(hex_digits[high]);
+                normal.push_back(hex_digits[low]);
+            }
+            i += 2;
+        }
+        else {
+            normal.push_back(str[i]);
+        }
+    }
+    return normal;
+}
+
+bool Url_canonicalizer::matches_param(const std::vector<std::string>& patterns,
+    const std::string& name) {
+    std::string lower_name = to_lower(name);
+    return std::any_of(patterns.begin(), patterns.end(), [&lower_name](const std::string& pattern) {
+        std::string lower_pattern = to_lower(pattern);
+        if (!lower_pattern.empty() and lower_pattern.back() == '*') {
+            lower_pattern.pop_back();
+            return lower_name.rfind(lower_pattern, 0) == 0;
+        }
+        return lower_name == lower_pattern;
+    });
+}
+
+Url_t Url_canonicalizer::canonical_query(const Url_t& query) const {
+    if (rules_.query_mode == query_strip_all) {
+        return "";
+    }
+    std::vector<std::pair<std::string, std::string>> params;
+    size_t begin_pos = 0;
+    while (begin_pos <= query.size()) {
+        size_t end_pos = std::min(query.find('&', begin_pos), query.size());
+        std::string param = normalize_percent_encoding(query.substr(begin_pos, end_pos - begin_pos));
+        begin_pos = end_pos + 1;
+        if (param.empty()) continue;
+        std::string name = param.substr(0, param.find('='));
+        bool keep = rules_.query_mode == query_whitelist ?
+            matches_param(rules_.whitelist_params, name) :
+            !matches_param(rules_.strip_params, name);
+        if (keep) {
+            params.emplace_back(std::move(name), std::move(param));
+        }
+    }
+    if (rules_.sort_query_params) {
+        std::stable_sort(params.begin(), params.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+    }
+    Url_t canon;
+    for (const auto& param: params) {
+        canon.append(canon.empty() ? "" : "&").append(param.second);
+    }
+    return canon;
+}
+
+void Url_canonicalizer::canonicalize(Page_path_t& page_path) const {
+    page_path.path = remove_dot_segments(normalize_percent_encoding(page_path.path));
+    if (page_path.path.empty()) {
+        page_path.path = "/";
+    }
+    page_path.page = normalize_percent_encoding(page_path.page);
+    page_path.query = canonical_query(page_path.query);
+}
+
+Url_t Url_canonicalizer::dedup_key(const Page_path_t& page_path) const {
+    Url_t key = page_path.path;
+    Url_t page = page_path.page;
+    if (rules_.remove_index_pages and !page.empty()) {
+        std::string lower_page = to_lower(page);
+        if (std::any_of(rules_.index_pages.begin(), rules_.index_pages.end(),
+            [&lower_page](const std::string& index_page) { 
+                return to_lower(index_page) == lower_page; })) {
+            page.clear();
+        }
+    }
+    // The trailing slash is the only difference between a directory's variants
+    while (key.size() > 1 and key.back() == '/') {
+        key.pop_back();
+    }
+    if (!page.empty()) {
+        key.append(key.empty() or key.back() != '/' ? "/" : "").append(page);
+    }
+    if (!page_path.query.empty()) {
+        key.append("?").append(page_path.query);
+    }
+    return key;
+}
@@ -0,0 +1,70 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <web_common.h>
+
+enum Query_param_mode {
+    // Keep every query parameter except the strip_params
+    query_keep_all,
+    // Keep only the whitelisted query parameters
+    query_whitelist,
+    // Drop the query string
+    query_strip_all
+};
+
+struct Url_canon_rules {
+    // index.html and friends are the same page as their directory
+    bool remove_index_pages{true};
+    std::vector<std::string> index_pages{"index.html", "index.htm",
+        "default.html", "default.htm"};
+    Query_param_mode query_mode{query_keep_all};
+    // Parameter names to keep with query_whitelist. A trailing * matches any suffix.
+    std::vector<std::string> whitelist_params;
+    // Parameter names to drop with query_keep_all. A trailing * matches any suffix.
+    std::vector<std::string> strip_params{"utm_*", "fbclid", "gclid", "msclkid",
+        "sessionid", "sid", "phpsessid", "jsessionid"};
+    // Order the parameters by name, so that ?a=1&b=2 and ?b=2&a=1 are one page
+    bool sort_query_params{true};
+};
+
+/// @brief Brings URLs to one canonical form, so equivalent URLs are only fetched once
+class Url_canonicalizer {
+public:
+    Url_canonicalizer(const Url_canon_rules& rules = Url_canon_rules{});
+
+    /// @brief Lowercases the scheme and host and drops the scheme's default port
+    static Url_t canonical_domain(const Url_t& domain);
+    /// @brief Resolves . and .. segments (RFC 3986 section 5.2.4)
+    static Url_t remove_dot_segments(const Url_t& path);
+    /// @brief Uppercases percent-encoding hex digits and decodes unreserved characters
+    static Url_t normalize_percent_encoding(const Url_t& str);
+    /// @brief Applies the query parameter rules
+    Url_t canonical_query(const Url_t& query) const;
+
+    /// @brief Canonicalizes the path, page and query of a page path in place.
+    /// The result is still the URL that is fetched.
+    void canonicalize(Page_path_t& page_path) const;
+
+    /// @brief The key that is the same for every variant of a page:
+    /// with or without a trailing slash or index page
+    Url_t dedup_key(const Page_path_t& page_path) const;
+
+private:
+    const Url_canon_rules rules_;
+
+    static bool matches_param(const std::vector<std::string>& patterns,
+        const std::string& name);
+};
@@ -0,0 +1,251 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+#include <url_frontier.h>
+#include <atomic>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <cstdint>
+
+extern "C" {
+#include <unistd.h>
+}
+
+static std::atomic_int next_frontier_id{0};
+
+Url_frontier::Url_frontier(const Frontier_config& config) : config_(config),
+    // Keep the spill batches well under the budget, so memory stays close to it
+    batch_bytes_(config.memory_budget_bytes == 0 ? config.spill_batch_bytes :
+        std::max<size_t>(1, std::min(config.spill_batch_bytes, config.memory_budget_bytes / 4))),
+    frontier_id_(next_frontier_id++) {}
+
+Url_frontier::~Url_frontier() {
+    {
+        std::lock_guard lock(io_mutex_);
+        stop_io_ = true;
+    }
+    io_cv_.notify_one();
+    if (io_thread_.joinable()) {
+        io_thread_.join();
+    }
+    std::error_code ec;
+    for (const Spill_segment& segment: segments_) {
+        if (segment.state == segment_on_disk) {
+            std::filesystem::remove(segment.file_path, ec);
+        }
+    }
+}
+
+void Url_frontier::push(const Page_path_t& path) {
+    size_t bytes = path_bytes(path);
+    ++size_;
+    if (!is_spilling() and (config_.memory_budget_bytes == 0 or
+        head_bytes_ + bytes <= config_.memory_budget_bytes)) {
+        head_.push_back(path);
+        head_bytes_ += bytes;
+        return;
+    }
+    // Once spilling starts, new paths queue behind the spilled ones to keep FIFO order
+    tail_.push_back(path);
+    tail_bytes_ += bytes;
+    if (tail_bytes_ >= batch_bytes_) {
+        spill_tail();
+    }
+}
+
+Opt_page_path_t Url_frontier::pop() {
+    Opt_page_path_t opt_path;
+    if (head_.empty()) {
+        refill_head();
+    }
+    if (!head_.empty()) {
+        opt_path = std::move(head_.front());
+        head_.pop_front();
+        head_bytes_ -= path_bytes(*opt_path);
+        --size_;
+        // Start reading the next segment once the head is down to its last batch
+        if (!prefetch_front_ and head_bytes_ <= batch_bytes_ and !segments_.empty()) {
+            {
+                std::lock_guard lock(io_mutex_);
+                prefetch_front_ = true;
+            }
+            io_cv_.notify_one();
+        }
+    }
+    return opt_path;
+}
+
+static void write_str(std::ofstream& out, const std::string& str) {
+    uint32_t len = static_cast<uint32_t>(str.size());
+    out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+    out.write(str.data(), len);
+}
+
+static bool read_str(std::ifstream& in, std::string& str) {
+    uint32_t len;
+    if (!in.read(reinterpret_cast<char*>(&len), sizeof(len))) return false;
+    str.resize(len);
+    return static_cast<bool>(in.read(str.data(), len));
+}
+
+static bool write_segment(const std::string& file_path, const std::vector<Page_path_t>& paths) {
+    std::ofstream out(file_path, std::ios::binary | std::ios::trunc);
+    for (const Page_path_t& path: paths) {
+        int32_t depth = path.depth;
+        out.write(reinterpret_cast<const char*>(&depth), sizeof(depth));
+        write_str(out, path.path);
+        write_str(out, path.page);
+        write_str(out, path.query);
+    }
+    out.close();
+    return static_cast<bool>(out);
+}
+
+static std::vector<Page_path_t> read_segment(const std::string& file_path, size_t num_paths) {
+    std::vector<Page_path_t> paths;
+    paths.reserve(num_paths);
+    std::ifstream in(file_path, std::ios::binary);
+    for (size_t i = 0; i < num_paths; ++i) {
+        Page_path_t path;
+        int32_t depth;
+        if (!in.read(reinterpret_cast<char*>(&depth), sizeof(depth)) or
+            !read_str(in, path.path) or !read_str(in, path.page) or
+            !read_str(in, path.query)) {
+            break;
+        }
+        path.depth = depth;
+        paths.push_back(std::move(path));
+    }
+    return paths;
+}
+
+void Url_frontier::spill_tail() {
+    if (spill_failed_) return;  // Already reported, keep the paths in memory
+    std::filesystem::path dir = config_.spill_dir.empty() ?
+        std::filesystem::temp_directory_path() : std::filesystem::path(config_.spill_dir);
+    std::string file_path = (dir / ("frontier-" + std::to_string(::getpid()) + "-" +
+        std::to_string(frontier_id_) + "-" + std::to_string(next_segment_num_++) + ".seg")).string();
+    {
+        std::unique_lock lock(io_mutex_);
+        // One segment is written at a time, so a slow disk holds back the pushes 
+        // rather than letting the queued segments grow without bound
+        io_done_cv_.wait(lock, [this] {
+            return segments_.empty() or (segments_.back().state != segment_queued and
+                segments_.back().state != segment_writing);
+        });
+        num_spilled_ += tail_.size();
+        segment_bytes_ += tail_bytes_;
+        segments_.push_back(Spill_segment{file_path, tail_.size(), tail_bytes_,
+            segment_queued, std::move(tail_)});
+        if (!io_thread_.joinable()) {
+            io_thread_ = std::thread(&Url_frontier::run_io, this);
+        }
+    }
+    io_cv_.notify_one();
+    tail_.clear();
+    tail_bytes_ = 0;
+}
+
+void Url_frontier::refill_head() {
+    std::unique_lock lock(io_mutex_);
+    if (!segments_.empty()) {
+        Spill_segment& segment = segments_.front();
+        // The segment is normally read back already. If not, have it read now.
+        prefetch_front_ = true;
+        io_cv_.notify_one();
+        io_done_cv_.wait(lock, [&segment] {
+            return segment.state == segment_queued or segment.state == segment_loaded;
+        });
+        if (segment.paths.size() < segment.num_paths) {
+            std::cout << "frontier error: reading " << segment.file_path << std::endl;
+            size_ -= segment.num_paths - segment.paths.size();
+        }
+        for (Page_path_t& path: segment.paths) {
+            head_bytes_ += path_bytes(path);
+            head_.push_back(std::move(path));
+        }
+        segment_bytes_ -= segment.num_bytes;
+        num_spilled_ -= segment.num_paths;
+        segments_.pop_front();
+        prefetch_front_ = false;
+    }
+    else if (!tail_.empty()) {
+        for (Page_path_t& path: tail_) {
+            head_.push_back(std::move(path));
+        }
+        head_bytes_ += tail_bytes_;
+        tail_bytes_ = 0;
+        tail_.clear();
+    }
+}
+
+Url_frontier::Spill_segment* Url_frontier::next_io_job() {
+    if (segments_.empty()) return nullptr;
+    // Reading the next segment goes first, a pop may be waiting on it
+    if (prefetch_front_ and segments_.front().state == segment_on_disk) {
+        return &segments_.front();
+    }
+    // Segments are written in order, so only the newest can still be queued
+    if (segments_.back().state == segment_queued) {
+        return &segments_.back();
+    }
+    return nullptr;
+}
+
+void Url_frontier::run_io() {
+    std::unique_lock lock(io_mutex_);
+    while (!stop_io_) {
+        Spill_segment* segment_ptr = next_io_job();
+        if (!segment_ptr) {
+            io_cv_.wait(lock);
+            continue;
+        }
+        // The frontier leaves a segment alone while it's being written or read,
+        // and pushes and pops on the deque don't move the other segments
+        Spill_segment& segment = *segment_ptr;
+        if (segment.state == segment_queued) {
+            segment.state = segment_writing;
+            lock.unlock();
+            bool is_written = write_segment(segment.file_path, segment.paths);
+            if (!is_written) {
+                std::cout << "frontier error: spilling to " << segment.file_path <<
+                    ", keeping the frontier in memory" << std::endl;
+                spill_failed_ = true;
+                std::error_code ec;
+                std::filesystem::remove(segment.file_path, ec);
+            }
+            lock.lock();
+            if (is_written) {
+                std::vector<Page_path_t>().swap(segment.paths);
+                segment_bytes_ -= segment.num_bytes;
+                segment.state = segment_on_disk;
+            }
+            else {
+                segment.state = segment_loaded;
+            }
+        }
+        else {
+            segment.state = segment_reading;
+            lock.unlock();
+            std::vector<Page_path_t> paths = read_segment(segment.file_path, segment.num_paths);
+            std::error_code ec;
+            std::filesystem::remove(segment.file_path, ec);
+            lock.lock();
+            segment.paths = std::move(paths);
+            segment_bytes_ += segment.num_bytes;
+            segment.state = segment_loaded;
+        }
+        io_done_cv_.notify_all();
+    }
+}
@@ -0,0 +1,114 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+#pragma once
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <web_common.h>
+
+struct Frontier_config {
+    // Bytes of pending paths kept in memory. 0 keeps them all in memory.
+    size_t memory_budget_bytes{0};
+    // Directory for the spilled segment files. Empty uses the system temp directory.
+    std::string spill_dir;
+    // Bytes of paths written to, and read back from, each segment file
+    size_t spill_batch_bytes{4 * 1024 * 1024};
+};
+
+/// @brief FIFO queue of the paths waiting to be crawled.
+/// Above the memory budget, newly pushed paths are written to sequential segment
+/// files and read back a segment at a time as the in-memory head drains.
+/// Memory stays near the budget however many paths are pending.
+/// The segment files are written and read back by a background thread. The next
+/// segment is read while the head drains, so pops rarely wait on the disk.
+/// The frontier isn't thread safe. Url_mgr serializes access to it.
+class Url_frontier {
+public:
+    Url_frontier(const Frontier_config& config = Frontier_config{});
+    ~Url_frontier();
+    Url_frontier(const Url_frontier&) = delete;
+    Url_frontier& operator=(const Url_frontier&) = delete;
+
+    void push(const Page_path_t& path);
+    Opt_page_path_t pop();
+    size_t size() const {
+        return size_;
+    }
+    bool empty() const {
+        return size_ == 0;
+    }
+    /// @brief Estimated bytes of the paths held in memory
+    size_t memory_bytes() const {
+        return head_bytes_ + tail_bytes_ + segment_bytes_;
+    }
+    /// @brief Number of paths handed off to segment files
+    size_t num_spilled() const {
+        return num_spilled_;
+    }
+
+private:
+    enum Segment_state {
+        segment_queued,     // Waiting to be written
+        segment_writing,
+        segment_on_disk,
+        segment_reading,
+        segment_loaded,     // Read back, or kept in memory when the write failed
+    };
+    struct Spill_segment {
+        std::string file_path;
+        size_t num_paths;
+        size_t num_bytes;
+        Segment_state state;
+        // Only held while the segment isn't on disk
+        std::vector<Page_path_t> paths;
+    };
+
+    const Frontier_config config_;
+    const size_t batch_bytes_;
+    const int frontier_id_;
+    // Pending paths in FIFO order: head_, then the segments, then tail_
+    std::deque<Page_path_t> head_;
+    std::deque<Spill_segment> segments_;
+    std::vector<Page_path_t> tail_;
+    size_t head_bytes_{0};
+    size_t tail_bytes_{0};
+    size_t size_{0};
+    size_t num_spilled_{0};
+    int next_segment_num_{0};
+    // The segments and their states are shared with the I/O thread
+    std::mutex io_mutex_;
+    std::condition_variable io_cv_;
+    std::condition_variable io_done_cv_;
+    std::thread io_thread_;
+    bool stop_io_{false};
+    bool prefetch_front_{false};
+    // Bytes of the segments' paths held in memory
+    std::atomic<size_t> segment_bytes_{0};
+    std::atomic<bool> spill_failed_{false};
+
+    static size_t path_bytes(const Page_path_t& path) {
+        return sizeof(Page_path_t) + path.path.size() + path.page.size() + path.query.size();
+    }
+    bool is_spilling() const {
+        return !segments_.empty() or !tail_.empty();
+    }
+    void spill_tail();
+    void refill_head();
+    void run_io();
+    Spill_segment* next_io_job();
+};
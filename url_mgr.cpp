@@ -11,6 +11,14 @@ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR I
  ***/
 
 #include <url_mgr.h>
+#include <trace_spans.h>
+#include <algorithm>
+#include <cctype>
+#include <map>
+
+extern "C" {
+#include <sched.h>
+}
 
 #include <iostream>
 void print_matches(const char* label, const std::smatch& m) {
@@ -21,20 +29,67 @@ void print_matches(const char* label, const std::smatch& m) {
     }
 };
 
-Url_mgr::Url_mgr(const Deconstructed_url& decon_url) : decon_url_(decon_url) {
-    Page_paths_t page_paths{Page_path_t{decon_url.path, decon_url.page, 1}};
-    update_page_paths(page_paths);
+Url_mgr::Url_mgr(const Deconstructed_url& decon_url, bool add_site_path,
+    const Url_mgr_config& config) : canon_(config.canon_rules),
+    decon_url_(canonical_site_url(decon_url)),
+    site_page_path_{decon_url_.path, decon_url_.page, 1, decon_url_.query},
+    skipped_extensions_(config.skipped_extensions.begin(), config.skipped_extensions.end()),
+    rules_(config.rules) {
+    make_frontier_shards(config);
+    if (add_site_path) {
+        Page_paths_t page_paths{site_page_path_};
+        update_page_paths(page_paths);
+    }
+}
+
+void Url_mgr::make_frontier_shards(const Url_mgr_config& config) {
+    std::map<int, int> node_shards;
+    if (config.numa_topology) {
+        for (const Cpu_info& info: config.numa_topology->cpus()) {
+            auto [iter, is_new] = node_shards.emplace(info.numa_node, node_shards.size());
+            if (info.cpu >= static_cast<int>(cpu_shards_.size())) {
+                cpu_shards_.resize(info.cpu + 1, 0);
+            }
+            cpu_shards_[info.cpu] = iter->second;
+        }
+    }
+    size_t num_shards = std::max<size_t>(node_shards.size(), 1);
+    // The shards split the memory budget
+    Frontier_config frontier_config = config.frontier;
+    frontier_config.memory_budget_bytes /= num_shards;
+    if (config.frontier.memory_budget_bytes > 0 and frontier_config.memory_budget_bytes == 0) {
+        frontier_config.memory_budget_bytes = 1;
+    }
+    for (size_t i = 0; i < num_shards; ++i) {
+        new_paths_.push_back(std::make_unique<Url_frontier>(frontier_config));
+    }
+}
+
+// The shard of the NUMA node the calling thread is running on
+int Url_mgr::thread_shard() const {
+    if (new_paths_.size() == 1) {
+        return 0;
+    }
+    int cpu = sched_getcpu();
+    return cpu >= 0 and cpu < static_cast<int>(cpu_shards_.size()) ? cpu_shards_[cpu] : 0;
+}
+
+Deconstructed_url Url_mgr::canonical_site_url(const Deconstructed_url& decon_url) const {
+    Page_path_t site_path{decon_url.path, decon_url.page, 1, decon_url.query};
+    canon_.canonicalize(site_path);
+    return Deconstructed_url{Url_canonicalizer::canonical_domain(decon_url.domain),
+        site_path.path, site_path.page, site_path.query};
 }
 
 Deconstructed_url Url_mgr::deconstruct_url(const Url_t& url, bool allow_page_path_only) {
     Deconstructed_url durl{};
     static const std::regex domain_re{
-        R"(^[Hh][Tt][Tt][Pp][Ss]?\://[a-zA-Z0-9\-]+(?:\.[a-zA-Z0-9\-]+)+)"
+        R"(^[Hh][Tt][Tt][Pp][Ss]?\://[a-zA-Z0-9\-]+(?:\.[a-zA-Z0-9\-]+)+(?:\:[0-9]+)?)"
     };
     static const std::regex page_re{
-        //  1. /                                  3. if extension then page, else end of path                                              4. extension  
-        //       2. begin path / means abs path, else relative        4. extension               
-        R"(^(/)?((?:[a-zA-Z0-9%_:\-]+/)+)?(?:\./)?([a-zA-Z0-9%_:\-]+)?(\.[Hh][Tt][Mm][Ll]?)?$)"
+        //  1. /                                          3. if extension then page, else end of path                      5. query
+        //       2. begin path / means abs path, else relative. Can have . and .. segments      4. extensions
+        R"(^(/)?((?:(?:\.\.?|[a-zA-Z0-9%_:~\-]+)/)+)?([a-zA-Z0-9%_:~\-]+)?((?:\.[a-zA-Z0-9]+)+)?(?:\?([^#]*))?$)"
     };
     std::smatch domain_m; 
     if (std::regex_search(url, domain_m, domain_re)) {
@@ -44,7 +99,9 @@ Deconstructed_url Url_mgr::deconstruct_url(const Url_t& url, bool allow_page_pat
     if (!durl.domain.empty() or allow_page_path_only) {
         std::smatch page_m;
         auto beg_iter = url.begin() + durl.domain.size();
-        if (std::regex_search(beg_iter, url.end(), page_m, page_re) and page_m.size() == 5) {
+        // The fragment is never sent to the server, so it's dropped, as it is from links
+        auto end_iter = std::find(beg_iter, url.end(), '#');
+        if (std::regex_search(beg_iter, end_iter, page_m, page_re) and page_m.size() == 6) {
             durl.path = page_m[1];
             durl.path.append(page_m[2]);
             if (page_m[4].length() == 0) {
@@ -54,35 +111,63 @@ Deconstructed_url Url_mgr::deconstruct_url(const Url_t& url, bool allow_page_pat
                 durl.page = page_m[3]; 
                 durl.page.append(page_m[4]);
             }
+            durl.query = page_m[5];
         }
         // print_matches("Page matches: ", page_m);
     }
     return durl;
 }
 
-std::string Url_mgr::make_page_path(const std::string& url_path, const std::string& url_page) {
+std::string Url_mgr::make_page_path(const std::string& url_path, const std::string& url_page,
+    const std::string& url_query) {
     return url_path + 
         (!url_page.empty() and ((url_path.empty() or url_path.back() != '/')) ? "/" : "") +
-        url_page;
+        url_page + (url_query.empty() ? "" : "?") + url_query;
 }
 
 Url_t Url_mgr::make_full_url(const Url_t& site_domain, 
-    const Url_t& url_path, const Url_t& url_page) {
-    return site_domain + make_page_path(url_path, url_page);
+    const Url_t& url_path, const Url_t& url_page, const Url_t& url_query) {
+    return site_domain + make_page_path(url_path, url_page, url_query);
 }
 
 Url_t Url_mgr::make_full_url(const Page_path_t& page_path) const {
-    return make_full_url(decon_url_.domain, page_path.path, page_path.page);
+    return make_full_url(decon_url_.domain, page_path);
+}
+
+// Links in HTML attributes escape & as &amp;
+static Url_t unescape_html_amps(const Url_t& url) {
+    Url_t unescaped = url;
+    for (size_t pos = unescaped.find("&amp;"); pos != std::string::npos;
+        pos = unescaped.find("&amp;", pos + 1)) {
+        unescaped.erase(pos + 1, 4);
+    }
+    return unescaped;
+}
+
+Opt_page_path_t Url_mgr::make_seed_path(const Url_t& url) const {
+    return make_child_path_from_link(url, Page_path_t{decon_url_.path, "", 0});
 }
 
 Opt_page_path_t Url_mgr::make_child_path_from_link(const Url_t& url, 
     const Page_path_t& parents_page) const {    
     Opt_page_path_t opt_page_path;           
-    Deconstructed_url decon_url = Url_mgr::deconstruct_url(url, true);
-    if (!decon_url.path.empty() || !decon_url.page.empty()) {
-        Url_t childs_path = make_child_path_from_links_path(decon_url.path, parents_page.path);
-        if (is_child_page(decon_url.domain, childs_path)) {
-            opt_page_path = Page_path_t{childs_path, decon_url.page, parents_page.depth + 1};
+    Deconstructed_url decon_url = Url_mgr::deconstruct_url(unescape_html_amps(url), true);
+    if (!decon_url.path.empty() || !decon_url.page.empty() || !decon_url.query.empty()) {
+        Page_path_t child_path{
+            make_child_path_from_links_path(decon_url.path, parents_page.path),
+            // A link that is only a query refers to the parent's page
+            decon_url.path.empty() and decon_url.page.empty() ? parents_page.page : decon_url.page,
+            parents_page.depth + 1, decon_url.query};
+        if (has_skipped_extension(child_path.page)) {
+            // Don't fetch what the processors can't use
+            return opt_page_path;
+        }
+        canon_.canonicalize(child_path);
+        Url_t links_domain = decon_url.domain.empty() ? decon_url.domain :
+            Url_canonicalizer::canonical_domain(decon_url.domain);
+        // The rules keep crawler traps out of the frontier
+        if (is_child_page(links_domain, child_path.path) and rules_.allows(child_path)) {
+            opt_page_path = std::move(child_path);
         }
     }
     return opt_page_path;
@@ -98,6 +183,17 @@ Url_t Url_mgr::make_child_path_from_links_path(const Url_t& links_path,
     return url_path;
 }
 
+bool Url_mgr::has_skipped_extension(const Url_t& page) const {
+    size_t dot_pos = page.rfind('.');
+    if (dot_pos == std::string::npos or skipped_extensions_.empty()) {
+        return false;
+    }
+    std::string extension = page.substr(dot_pos + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+        [](unsigned char c) { return std::tolower(c); });
+    return skipped_extensions_.count(extension) > 0;
+}
+
 bool Url_mgr::is_child_page(const Url_t& links_domain, const Url_t& links_url_path) const {
     bool is_child = (
         // The link has no domain or they match and
@@ -143,28 +239,59 @@ Page_paths_t Url_mgr::extract_child_page_paths(const Page_content_t& content,
     return paths;
 }
 
+// Traced, to show the time threads queue for the frontier
+std::unique_lock<std::mutex> Url_mgr::lock_mgr() {
+    Trace_span span{"frontier_lock_wait"};
+    return std::unique_lock(mgr_mutex_);
+}
+
 void Url_mgr::update_page_paths(const Page_paths_t& page_paths) {
-    std::lock_guard lock(mgr_mutex_);
+    auto lock = lock_mgr();
+    add_new_paths(page_paths);
+}
+
+void Url_mgr::add_seed_paths(const Page_paths_t& page_paths) {
+    auto lock = lock_mgr();
+    // Seed files load millions of paths at once
+    existing_paths_.reserve(existing_paths_.size() + page_paths.size());
+    // The loading thread is on one node, so the seeds are dealt out to every node's shard
+    add_new_paths(page_paths, true);
+}
+
+// mgr_mutex_ is held by the caller.
+// A crawling thread's new paths go to its own node's shard. 
+void Url_mgr::add_new_paths(const Page_paths_t& page_paths, bool spread_shards) {
+    int shard = thread_shard();
     for (const Page_path_t& page_path: page_paths) {
-        Url_t page_path_str = make_page_path(page_path.path, page_path.page);
-        auto existing_result = existing_paths_.emplace(page_path_str);
+        auto existing_result = existing_paths_.emplace(canon_.dedup_key(page_path));
         if (existing_result.second) { // The path is new
-            new_paths_.push_back(page_path);
+            if (spread_shards) {
+                shard = next_seed_shard_++ % new_paths_.size();
+            }
+            new_paths_[shard]->push(page_path);
         }
     }
 }
 
+// Pops from the thread's own node's shard, and takes from the other nodes' 
+// shards once it's empty
 Opt_page_path_t Url_mgr::pop_new_path() {
-    Opt_page_path_t opt_path;
-    std::lock_guard lock(mgr_mutex_);
-    if (!new_paths_.empty()) {
-        opt_path = std::move(new_paths_.front());
-        new_paths_.pop_front();
+    auto lock = lock_mgr();
+    size_t shard = thread_shard();
+    for (size_t i = 0; i < new_paths_.size(); ++i) {
+        Url_frontier& frontier = *new_paths_[(shard + i) % new_paths_.size()];
+        if (!frontier.empty()) {
+            return frontier.pop();
+        }
     }
-    return opt_path;
+    return Opt_page_path_t{};
 }
 
 int Url_mgr::num_new_paths() {
-    std::lock_guard lock(mgr_mutex_);
-    return new_paths_.size();
+    auto lock = lock_mgr();
+    size_t num_paths = 0;
+    for (const auto& frontier: new_paths_) {
+        num_paths += frontier->size();
+    }
+    return num_paths;
 }
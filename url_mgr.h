@@ -14,46 +14,108 @@ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR I
 
 #include <unordered_set>
 #include <regex>
-#include <list>
 #include <mutex>
+#include <memory>
+#include <optional>
 #include <web_common.h>
+#include <cpu_topology.h>
+#include <url_frontier.h>
+#include <url_canon.h>
+#include <url_rules.h>
 
 struct Deconstructed_url {
     std::string domain;
     std::string path;
     std::string page;
+    std::string query;
+};
+
+struct Url_mgr_config {
+    Frontier_config frontier;
+    Url_canon_rules canon_rules;
+    // Include and exclude patterns and limits for the URLs that are crawled
+    Url_rules_config rules;
+    // Splits the pending paths into one frontier shard per NUMA node of the topology. 
+    // Threads push to and pop from their own node's shard first, so the paths stay
+    // in that node's memory. Unset keeps a single shard.
+    std::optional<Cpu_topology> numa_topology;
+    // Links to pages with these extensions aren't crawled. They're compared ignoring case.
+    std::vector<std::string> skipped_extensions{
+        "pdf", "ps", "doc", "docx", "xls", "xlsx", "ppt", "pptx", "odt",
+        "jpg", "jpeg", "png", "gif", "bmp", "svg", "webp", "ico", "tif", "tiff",
+        "mp3", "mp4", "m4a", "avi", "mov", "mkv", "webm", "ogg", "wav", "flac",
+        "zip", "gz", "tgz", "bz2", "xz", "7z", "rar", "tar", "iso", "dmg", "exe", "msi",
+        "deb", "rpm", "jar", "bin", "css", "js", "woff", "woff2", "ttf", "eot"};
 };
 
 class Url_mgr {
 public:
-    Url_mgr(const Deconstructed_url& decon_url);
+    /// @param decon_url [in] The site's URL
+    /// @param add_site_path [in] Add the site's page as the first new path
+    /// @param config [in] Frontier and URL canonicalization settings
+    Url_mgr(const Deconstructed_url& decon_url, bool add_site_path = true,
+        const Url_mgr_config& config = Url_mgr_config{});
     static Deconstructed_url deconstruct_url(const Url_t& url, 
         bool allow_page_path_only = false);
     static Url_t make_page_path(const std::string& url_path, 
-        const std::string& url_page);
+        const std::string& url_page, const std::string& url_query = "");
+    static Url_t make_page_path(const Page_path_t& page_path) {
+        return make_page_path(page_path.path, page_path.page, page_path.query);
+    }
     static Url_t make_full_url(const Url_t& site_domain, 
-        const Url_t& url_path, const Url_t& url_page);
+        const Url_t& url_path, const Url_t& url_page, const Url_t& url_query = "");
+    static Url_t make_full_url(const Url_t& site_domain, const Page_path_t& page_path) {
+        return make_full_url(site_domain, page_path.path, page_path.page, page_path.query);
+    }
     const Url_t& site_domain() const {
         return decon_url_.domain;
     }
+    /// @brief The canonical path of the site's page
+    const Page_path_t& site_page_path() const {
+        return site_page_path_;
+    }
     Url_t make_full_url(const Page_path_t& path) const;
+    /// @brief The canonical page path of a seed URL, or nothing when it's 
+    /// invalid or outside the site. Seeds are at depth 1, like the site's page.
+    /// Relative seeds are relative to the site's path.
+    Opt_page_path_t make_seed_path(const Url_t& url) const;
     Page_paths_t extract_child_page_paths(const Page_content_t& content, 
         const Page_path_t& parent_path) const;
     void update_page_paths(const Page_paths_t& page_paths);
+    /// @brief Adds a bulk load of paths, e.g. a seed file's, sizing the 
+    /// path set for them up front
+    void add_seed_paths(const Page_paths_t& page_paths);
     Opt_page_path_t pop_new_path();
     int num_new_paths();
+    int num_frontier_shards() const {
+        return static_cast<int>(new_paths_.size());
+    }
 private:
+    const Url_canonicalizer canon_;
     const Deconstructed_url decon_url_;
+    const Page_path_t site_page_path_;
+    const std::unordered_set<std::string> skipped_extensions_;
+    const Url_rules rules_;
     std::mutex mgr_mutex_;
     using Url_set_t = std::unordered_set<Url_t>;
     Url_set_t existing_paths_;
-    std::list<Page_path_t> new_paths_;
+    // One shard per NUMA node
+    std::vector<std::unique_ptr<Url_frontier>> new_paths_;
+    // The shard of each CPU's NUMA node, indexed by CPU
+    std::vector<int> cpu_shards_;
+    size_t next_seed_shard_{0};
 
+    void add_new_paths(const Page_paths_t& page_paths, bool spread_shards = false);
+    void make_frontier_shards(const Url_mgr_config& config);
+    int thread_shard() const;
     Opt_page_path_t make_child_path_from_link(const Url_t& url, 
         const Page_path_t& parents_page) const;
     Url_t make_child_path_from_links_path(const Url_t& links_path,
         const Url_t& parents_path) const;
     bool is_child_page(const Url_t& links_domain,
         const Url_t& links_url_path) const;
+    bool has_skipped_extension(const Url_t& page) const;
+    std::unique_lock<std::mutex> lock_mgr();
+    Deconstructed_url canonical_site_url(const Deconstructed_url& decon_url) const;
 };
 
@@ -0,0 +1,548 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+
+#include <url_rules.h>
+#include <algorithm>
+#include <bitset>
+#include <map>
+#include <optional>
+#include <iostream>
+#include <cctype>
+#include <cstring>
+
+using Char_set_t = std::bitset<256>;
+
+// A Thompson NFA state. It reaches next on a character in chars, and
+// the eps states without consuming one.
+struct Nfa_state {
+    Char_set_t chars;
+    int next{-1};
+    std::vector<int> eps;
+    uint8_t accept{0};
+};
+
+// Part of the NFA with one way in and one way out. end has no transitions yet.
+struct Nfa_fragment {
+    int start;
+    int end;
+};
+
+// Recursive descent parser for the regex subset, which builds the pattern's NFA fragment
+class Pattern_parser {
+public:
+    Pattern_parser(std::vector<Nfa_state>& states, std::string_view pattern) :
+        states_(states), pattern_(pattern) {}
+
+    /// @return The pattern's fragment, or nothing when it's invalid
+    std::optional<Nfa_fragment> parse() {
+        Nfa_fragment frag;
+        if (!parse_alternation(frag)) {
+            return std::nullopt;
+        }
+        if (pos_ < pattern_.size()) {
+            error_ = "unmatched )";
+            return std::nullopt;
+        }
+        return frag;
+    }
+    const char* error() const {
+        return error_;
+    }
+
+private:
+    std::vector<Nfa_state>& states_;
+    const std::string_view pattern_;
+    size_t pos_{0};
+    const char* error_{""};
+
+    int add_state() {
+        states_.emplace_back();
+        return static_cast<int>(states_.size() - 1);
+    }
+    Nfa_fragment add_fragment() {
+        int start = add_state();
+        return Nfa_fragment{start, add_state()};
+    }
+    Nfa_fragment chars_fragment(const Char_set_t& chars) {
+        Nfa_fragment frag = add_fragment();
+        states_[frag.start].chars = chars;
+        states_[frag.start].next = frag.end;
+        return frag;
+    }
+    Nfa_fragment empty_fragment() {
+        Nfa_fragment frag = add_fragment();
+        states_[frag.start].eps.push_back(frag.end);
+        return frag;
+    }
+    Nfa_fragment concatenate(Nfa_fragment first, Nfa_fragment second) {
+        states_[first.end].eps.push_back(second.start);
+        return Nfa_fragment{first.start, second.end};
+    }
+    Nfa_fragment alternate(Nfa_fragment first, Nfa_fragment second) {
+        Nfa_fragment frag = add_fragment();
+        states_[frag.start].eps = {first.start, second.start};
+        states_[first.end].eps.push_back(frag.end);
+        states_[second.end].eps.push_back(frag.end);
+        return frag;
+    }
+    // *, + or ?
+    Nfa_fragment repeat(Nfa_fragment item, char op) {
+        Nfa_fragment frag = add_fragment();
+        states_[frag.start].eps.push_back(item.start);
+        if (op != '+') {
+            states_[frag.start].eps.push_back(frag.end);
+        }
+        if (op != '?') {
+            states_[item.end].eps.push_back(item.start);
+        }
+        states_[item.end].eps.push_back(frag.end);
+        return frag;
+    }
+    bool at(char c) const {
+        return pos_ < pattern_.size() and pattern_[pos_] == c;
+    }
+
+    bool parse_alternation(Nfa_fragment& frag) {
+        if (!parse_concatenation(frag)) {
+            return false;
+        }
+        while (at('|')) {
+            ++pos_;
+            Nfa_fragment other;
+            if (!parse_concatenation(other)) {
+                return false;
+            }
+            frag = alternate(frag, other);
+        }
+        return true;
+    }
+    bool parse_concatenation(Nfa_fragment& frag) {
+        bool has_items = false;
+        while (pos_ < pattern_.size() and !at('|') and !at(')')) {
+            Nfa_fragment item;
+            if (!parse_repetition(item)) {
+                return false;
+            }
+            frag = has_items ? concatenate(frag, item) : item;
+            has_items = true;
+        }
+        if (!has_items) {
+            frag = empty_fragment();
+        }
+        return true;
+    }
+    bool parse_repetition(Nfa_fragment& frag) {
+        if (!parse_atom(frag)) {
+            return false;
+        }
+        while (at('*') or at('+') or at('?')) {
+            frag = repeat(frag, pattern_[pos_++]);
+        }
+        return true;
+    }
+    bool parse_atom(Nfa_fragment& frag) {
+        char c = pattern_[pos_++];
+        Char_set_t chars;
+        switch (c) {
+            case '(':
+                if (!parse_alternation(frag)) {
+                    return false;
+                }
+                if (!at(')')) {
+                    error_ = "missing )";
+                    return false;
+                }
+                ++pos_;
+                return true;
+            case '*': case '+': case '?':
+                error_ = "nothing to repeat";
+                return false;
+            case '^': case '$':
+                error_ = "^ and $ only anchor the start and end";
+                return false;
+            case '[':
+                if (!parse_class(chars)) {
+                    return false;
+                }
+                break;
+            case '.':
+                chars.set();
+                break;
+            case '\\':
+                if (!parse_escape(chars)) {
+                    return false;
+                }
+                break;
+            default:
+                chars.set(static_cast<unsigned char>(c));
+                break;
+        }
+        frag = chars_fragment(chars);
+        return true;
+    }
+    // After the [. A ] first in the set is a literal.
+    bool parse_class(Char_set_t& chars) {
+        bool negated = at('^');
+        pos_ += negated;
+        for (bool first = true; !at(']') or first; first = false) {
+            if (pos_ >= pattern_.size()) {
+                error_ = "missing ]";
+                return false;
+            }
+            unsigned char c = pattern_[pos_++];
+            if (c == '\\') {
+                if (!parse_escape(chars)) {
+                    return false;
+                }
+            }
+            else if (at('-') and pos_ + 1 < pattern_.size() and pattern_[pos_ + 1] != ']') {
+                unsigned char last = pattern_[pos_ + 1];
+                pos_ += 2;
+                for (unsigned int range_c = c; range_c <= last; ++range_c) {
+                    chars.set(range_c);
+                }
+            }
+            else {
+                chars.set(c);
+            }
+        }
+        ++pos_;
+        if (negated) {
+            chars.flip();
+        }
+        return true;
+    }
+    // After the backslash
+    bool parse_escape(Char_set_t& chars) {
+        if (pos_ >= pattern_.size()) {
+            error_ = "trailing \\";
+            return false;
+        }
+        char c = pattern_[pos_++];
+        for (int set_c = 0; set_c < 256; ++set_c) {
+            if ((c == 'd' and std::isdigit(set_c)) or 
+                (c == 'w' and (std::isalnum(set_c) or set_c == '_')) or
+                (c == 's' and std::isspace(set_c))) {
+                chars.set(set_c);
+            }
+        }
+        if (c != 'd' and c != 'w' and c != 's') {
+            chars.set(static_cast<unsigned char>(c));
+        }
+        return true;
+    }
+};
+
+// Globs become the equivalent regex, which matches the whole string
+static std::string glob_to_regex(std::string_view glob) {
+    std::string re;
+    for (size_t i = 0; i < glob.size(); ++i) {
+        char c = glob[i];
+        if (c == '*' and i + 1 < glob.size() and glob[i + 1] == '*') {
+            re += ".*";
+            ++i;
+        }
+        else if (c == '*') {
+            re += "[^/]*";
+        }
+        else if (c == '?') {
+            re += '.';
+        }
+        else if (c == '[') {
+            size_t set_pos = i + 1 + (i + 1 < glob.size() and glob[i + 1] == '!');
+            // A ] first in the set is a literal
+            size_t end_pos = glob.find(']', set_pos + 1);
+            if (end_pos == std::string_view::npos) {
+                re += "\\[";
+            }
+            else {
+                re.append(set_pos > i + 1 ? "[^" : "[")
+                    .append(glob.substr(set_pos, end_pos - set_pos)) += ']';
+                i = end_pos;
+            }
+        }
+        else {
+            if (std::strchr("\\.()|+^$]", c)) {
+                re += '\\';
+            }
+            re += c;
+        }
+    }
+    return re;
+}
+
+// A top level alternative of a pattern, in the regex subset.
+// The DFA shares the states for unanchored ends between all the patterns.
+struct Pattern_alternative {
+    std::string re;
+    // Anything can come before it
+    bool any_prefix;
+    // Anything can follow it
+    bool any_suffix;
+};
+
+// Whether the character at pos follows an odd number of backslashes
+static bool is_escaped(std::string_view re, size_t pos) {
+    size_t num_backslashes = 0;
+    while (num_backslashes < pos and re[pos - 1 - num_backslashes] == '\\') {
+        ++num_backslashes;
+    }
+    return num_backslashes % 2 == 1;
+}
+
+static bool is_any_suffix(std::string_view re) {
+    return re.size() >= 2 and re.substr(re.size() - 2) == ".*" and 
+        !is_escaped(re, re.size() - 2);
+}
+
+// Globs match the whole string, apart from a leading or trailing **
+static Pattern_alternative glob_alternative(std::string_view glob) {
+    Pattern_alternative alt{glob_to_regex(glob), false, false};
+    if (alt.re.rfind(".*", 0) == 0) {
+        alt.re.erase(0, 2);
+        alt.any_prefix = true;
+    }
+    if (is_any_suffix(alt.re)) {
+        alt.re.erase(alt.re.size() - 2);
+        alt.any_suffix = true;
+    }
+    return alt;
+}
+
+// A regex is found anywhere in the string unless it's anchored. 
+// Each top level alternative has its own anchors, like ^a|b$ is (^a)|(b$).
+static std::vector<Pattern_alternative> regex_alternatives(std::string_view re) {
+    std::vector<Pattern_alternative> alts;
+    auto add_alternative = [&alts](std::string_view alt_re) {
+        bool is_start_anchored = alt_re.rfind('^', 0) == 0;
+        if (is_start_anchored) {
+            alt_re.remove_prefix(1);
+        }
+        bool is_end_anchored = !alt_re.empty() and alt_re.back() == '$' and 
+            !is_escaped(alt_re, alt_re.size() - 1);
+        if (is_end_anchored) {
+            alt_re.remove_suffix(1);
+        }
+        alts.push_back(Pattern_alternative{std::string{alt_re}, 
+            !is_start_anchored, !is_end_anchored});
+    };
+    int depth = 0;
+    bool in_class = false;
+    size_t class_pos = 0;
+    size_t begin_pos = 0;
+    for (size_t pos = 0; pos < re.size(); ++pos) {
+        char c = re[pos];
+        if (c == '\\' and pos + 1 < re.size()) {
+            ++pos;
+        }
+        else if (in_class) {
+            // A ] first in the set is a literal
+            in_class = c != ']' or pos == class_pos;
+        }
+        else if (c == '[') {
+            in_class = true;
+            class_pos = pos + 1 + (pos + 1 < re.size() and re[pos + 1] == '^');
+        }
+        else if (c == '(' or c == ')') {
+            depth += c == '(' ? 1 : -1;
+        }
+        else if (c == '|' and depth == 0) {
+            add_alternative(re.substr(begin_pos, pos - begin_pos));
+            begin_pos = pos + 1;
+        }
+    }
+    add_alternative(re.substr(begin_pos));
+    return alts;
+}
+
+Url_rules::Url_rules(const Url_rules_config& config) : 
+    max_path_depth_(config.max_path_depth), max_query_params_(config.max_query_params) {
+    is_valid_ = compile(config);
+    if (!is_valid_) {
+        // Match nothing, so only the limits apply
+        has_patterns_ = has_includes_ = false;
+        num_byte_classes_ = 1;
+        byte_classes_.fill(0);
+        transitions_.assign(2, 0);
+        accepts_.assign(2, 0);
+    }
+}
+
+bool Url_rules::compile(const Url_rules_config& config) {
+    has_includes_ = !config.include_patterns.empty();
+    has_patterns_ = has_includes_ or !config.exclude_patterns.empty();
+    // The states every pattern shares. Start begins the anchored patterns, and 
+    // search loops over any prefix to begin the unanchored ones. The sinks loop 
+    // over any suffix once a pattern has matched, so the DFA only has to remember 
+    // the kind of pattern that matched, not which one.
+    enum { start_state, search_state, include_sink, exclude_sink, num_shared_states };
+    std::vector<Nfa_state> states(num_shared_states);
+    states[start_state].eps.push_back(search_state);
+    for (int loop_state: {search_state, include_sink, exclude_sink}) {
+        states[loop_state].chars.set();
+        states[loop_state].next = loop_state;
+    }
+    states[include_sink].accept = accept_include;
+    states[exclude_sink].accept = accept_exclude;
+    auto add_patterns = [&states](const std::vector<std::string>& patterns, uint8_t accept) {
+        int sink = accept == accept_include ? include_sink : exclude_sink;
+        for (const std::string& pattern: patterns) {
+            std::vector<Pattern_alternative> alts = pattern.rfind("re:", 0) == 0 ? 
+                regex_alternatives(std::string_view{pattern}.substr(3)) : 
+                std::vector<Pattern_alternative>{glob_alternative(pattern)};
+            for (const Pattern_alternative& alt: alts) {
+                Pattern_parser parser(states, alt.re);
+                std::optional<Nfa_fragment> frag = parser.parse();
+                if (!frag) {
+                    std::cout << "url rules error: " << pattern << ": " << parser.error() << std::endl;
+                    return false;
+                }
+                states[alt.any_prefix ? search_state : start_state].eps.push_back(frag->start);
+                if (alt.any_suffix) {
+                    states[frag->end].eps.push_back(sink);
+                }
+                else {
+                    states[frag->end].accept |= accept;
+                }
+            }
+        }
+        return true;
+    };
+    if (!add_patterns(config.include_patterns, accept_include) or
+        !add_patterns(config.exclude_patterns, accept_exclude)) {
+        return false;
+    }
+
+    // Bytes that are in the same character sets get the same class
+    std::vector<int> char_states;
+    for (size_t s = 0; s < states.size(); ++s) {
+        if (states[s].next >= 0) {
+            char_states.push_back(static_cast<int>(s));
+        }
+    }
+    std::map<std::vector<bool>, uint8_t> class_ids;
+    std::vector<unsigned char> class_bytes;
+    for (int c = 0; c < 256; ++c) {
+        std::vector<bool> membership;
+        membership.reserve(char_states.size());
+        for (int s: char_states) {
+            membership.push_back(states[s].chars.test(c));
+        }
+        auto [iter, is_new] = class_ids.emplace(std::move(membership), 
+            static_cast<uint8_t>(class_bytes.size()));
+        if (is_new) {
+            class_bytes.push_back(static_cast<unsigned char>(c));
+        }
+        byte_classes_[c] = iter->second;
+    }
+    num_byte_classes_ = class_bytes.size();
+
+    // Subset construction. Each DFA state is the set of NFA states the match can be in.
+    std::vector<char> in_closure(states.size());
+    auto closure = [&states, &in_closure](std::vector<int> set) {
+        std::fill(in_closure.begin(), in_closure.end(), 0);
+        for (int s: set) {
+            in_closure[s] = 1;
+        }
+        for (size_t i = 0; i < set.size(); ++i) {
+            for (int eps_s: states[set[i]].eps) {
+                if (!in_closure[eps_s]) {
+                    in_closure[eps_s] = 1;
+                    set.push_back(eps_s);
+                }
+            }
+        }
+        // An excluded URL stays excluded, whatever else matches
+        if (in_closure[exclude_sink]) {
+            return std::vector<int>{exclude_sink};
+        }
+        std::sort(set.begin(), set.end());
+        return set;
+    };
+    std::map<std::vector<int>, uint32_t> dfa_ids{{std::vector<int>{}, 0}};
+    std::vector<std::vector<int>> dfa_sets{std::vector<int>{}};
+    accepts_.assign(1, 0);
+    auto dfa_state = [&](std::vector<int> set) {
+        auto [iter, is_new] = dfa_ids.emplace(std::move(set), static_cast<uint32_t>(dfa_sets.size()));
+        if (is_new) {
+            uint8_t accept = 0;
+            for (int s: iter->first) {
+                accept |= states[s].accept;
+            }
+            dfa_sets.push_back(iter->first);
+            accepts_.push_back(accept);
+        }
+        return iter->second;
+    };
+    dfa_state(closure({start_state}));
+    transitions_.assign(num_byte_classes_, 0);
+    for (size_t d = 1; d < dfa_sets.size(); ++d) {
+        if (dfa_sets.size() > max_dfa_states) {
+            std::cout << "url rules error: the patterns need more than " << 
+                max_dfa_states << " DFA states" << std::endl;
+            return false;
+        }
+        std::vector<int> set = dfa_sets[d];
+        transitions_.resize((d + 1) * num_byte_classes_);
+        for (size_t byte_class = 0; byte_class < num_byte_classes_; ++byte_class) {
+            std::vector<int> moved;
+            for (int s: set) {
+                if (states[s].next >= 0 and states[s].chars.test(class_bytes[byte_class])) {
+                    moved.push_back(states[s].next);
+                }
+            }
+            transitions_[d * num_byte_classes_ + byte_class] = 
+                moved.empty() ? 0 : dfa_state(closure(std::move(moved)));
+        }
+    }
+    return true;
+}
+
+bool Url_rules::allows(const Page_path_t& page_path) const {
+    if (!has_patterns_ and max_path_depth_ == 0 and max_query_params_ == 0) {
+        return true;
+    }
+    // The DFA runs over the path the way make_page_path joins it, without building it
+    uint32_t state = 1;
+    int path_depth = 0;
+    char prev_c = '/';
+    for (char c: page_path.path) {
+        path_depth += prev_c == '/' and c != '/';
+        prev_c = c;
+        state = next_state(state, c);
+    }
+    if (max_path_depth_ > 0 and path_depth > max_path_depth_) {
+        return false;
+    }
+    if (!page_path.page.empty() and (page_path.path.empty() or page_path.path.back() != '/')) {
+        state = next_state(state, '/');
+    }
+    for (char c: page_path.page) {
+        state = next_state(state, c);
+    }
+    if (!page_path.query.empty()) {
+        state = next_state(state, '?');
+        int num_params = 0;
+        prev_c = '&';
+        for (char c: page_path.query) {
+            num_params += prev_c == '&' and c != '&';
+            prev_c = c;
+            state = next_state(state, c);
+        }
+        if (max_query_params_ > 0 and num_params > max_query_params_) {
+            return false;
+        }
+    }
+    uint8_t accept = accepts_[state];
+    return (!has_includes_ or (accept & accept_include)) and !(accept & accept_exclude);
+}
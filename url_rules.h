@@ -0,0 +1,84 @@
+/***
+ # Released under the MIT License
+
+ Copyright (C) 2024 Jeff Platzer <jeff@platzers.us>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ***/
+
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <web_common.h>
+
+struct Url_rules_config {
+    // Only URLs that match one of these are crawled. Empty includes every URL.
+    std::vector<std::string> include_patterns;
+    // URLs that match one of these aren't crawled, even when they're included
+    std::vector<std::string> exclude_patterns;
+    // Most directories in a URL's path, e.g. 2 for /a/b/page.html. 0 is unlimited.
+    int max_path_depth{0};
+    // Most parameters in a URL's query. 0 is unlimited.
+    int max_query_params{0};
+};
+
+/// @brief Decides which of the site's URLs are crawled, to keep crawler traps
+/// like calendars and faceted searches out of the frontier.
+/// Patterns are matched against the URL's path, page and query, like /docs/a.html?x=1.
+/// Globs match the whole string. * matches within a path segment, ** matches across
+/// segments, ? matches one character and [a-z] or [!a-z] one character of a set.
+/// Patterns that start with re: are regular expressions, found anywhere in the string
+/// unless anchored with ^ or $. They support . [] () | * + ? and \ escapes, 
+/// including \d \w \s.
+/// All the patterns are compiled into one DFA, so a URL is checked in a single pass
+/// over its characters however many patterns there are. Unanchored patterns share 
+/// their prefix and suffix states, which keeps the DFA close to the patterns' size.
+class Url_rules {
+public:
+    Url_rules(const Url_rules_config& config = Url_rules_config{});
+
+    /// @brief False when a pattern didn't compile. The error is reported and
+    /// the patterns are left out.
+    bool is_valid() const {
+        return is_valid_;
+    }
+    /// @brief Whether the path passes the patterns and limits
+    bool allows(const Page_path_t& page_path) const;
+    size_t num_dfa_states() const {
+        return accepts_.size();
+    }
+
+    // Each DFA state records which kinds of pattern have matched
+    enum Accept_flags : uint8_t {
+        accept_include = 1 << 0,
+        accept_exclude = 1 << 1
+    };
+    static constexpr size_t max_dfa_states = 1 << 16;
+
+private:
+    bool is_valid_{true};
+    bool has_patterns_{false};
+    bool has_includes_{false};
+    const int max_path_depth_;
+    const int max_query_params_;
+    // Bytes that every pattern treats alike share a class, which keeps the table small
+    std::array<uint8_t, 256> byte_classes_{};
+    size_t num_byte_classes_{1};
+    // State 0 matches nothing, and the match starts in state 1
+    std::vector<uint32_t> transitions_;
+    std::vector<uint8_t> accepts_;
+
+    bool compile(const Url_rules_config& config);
+    uint32_t next_state(uint32_t state, unsigned char c) const {
+        return transitions_[state * num_byte_classes_ + byte_classes_[c]];
+    }
+};
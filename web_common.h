@@ -13,6 +13,7 @@ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR I
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
 #include <utility>
@@ -23,9 +24,12 @@ struct Page_path_t {
     Url_t path;
     Url_t page;
     int depth;
+    // Query string without the leading ?
+    Url_t query{};
 };
 
-using Page_content_t = std::string;
+// Views the page's content, which is only valid while its page is processed
+using Page_content_t = std::string_view;
 using Page_paths_t = std::vector<Page_path_t>;
 using Opt_page_path_t = std::optional<Page_path_t>;
 
@@ -37,7 +41,17 @@ enum Http_code {
     http_forbidden = 403,
     http_not_found = 404,
     http_request_timeout = 408,
-    http_internal_error = 500
+    // The response is bigger than the reader allows
+    http_payload_too_large = 413,
+    // The response isn't HTML, so it wasn't downloaded
+    http_unsupported_media_type = 415,
+    http_too_many_requests = 429,
+    // The crawl was cancelled while the page was read (nginx's client closed request)
+    http_request_cancelled = 499,
+    http_internal_error = 500,
+    http_bad_gateway = 502,
+    http_service_unavailable = 503,
+    http_gateway_timeout = 504
 };
 
 // The Err_t error class/type must support an empty and a copy ctor
@@ -16,12 +16,67 @@ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR I
 #include <atomic>
 #include <semaphore>
 #include <memory>
+#include <chrono>
+#include <mutex>
+#include <queue>
+#include <optional>
+#include <concepts>
+#include <algorithm>
+#include <system_error>
 #include <thread_pool.h>
+#include <cpu_topology.h>
+#include <trace_spans.h>
+#include <memory_accountant.h>
 #include <web_common.h>
 #include <url_mgr.h>
+#include <crawl_cluster.h>
+#include <host_health.h>
+#include <revisit_scheduler.h>
+#include <seed_loader.h>
+#include <web_page_reader.h>
+
+/// @brief What a processor uses of each page. The crawler skips building, 
+/// or frees early, what no processor uses.
+enum Processor_needs : unsigned {
+    // Only the page's URL, HTTP code and depth
+    processor_needs_headers = 0,
+    // The paths of the page's links
+    processor_needs_links = 1 << 0,
+    // The page's complete content
+    processor_needs_body = 1 << 1,
+    // The content in pieces as it's read, to process_body_chunk
+    processor_needs_body_stream = 1 << 2,
+    // The response's status line and header lines as received, to process_response_headers
+    processor_needs_response_headers = 1 << 3,
+    processor_needs_all = processor_needs_links | processor_needs_body
+};
 
 class Page_content_processor {
 public: 
+    /// @brief What the processor uses of each page, from Processor_needs.
+    /// The links and content passed to process_page_content are empty 
+    /// when they aren't needed.
+    virtual unsigned needs() const {
+        return processor_needs_all;
+    }
+
+    /// @brief Called with each piece of a page's content as it's read,
+    /// when needs() includes processor_needs_body_stream. 
+    /// The pieces are passed on the thread that then calls process_page_content
+    /// for the page, unless the read is retried or the page is an unchanged revisit.
+    /// @param page_url [in] The page's URL
+    /// @param offset [in] The piece's position in the content. 0 starts a new read.
+    /// @param chunk [in] The piece, only valid during the call
+    virtual void process_body_chunk(const Url_t& page_url, size_t offset, 
+        Page_content_t chunk) {}
+
+    /// @brief Called with the page's response headers just before process_page_content,
+    /// on the same thread, when needs() includes processor_needs_response_headers.
+    /// @param page_url [in] The page's URL
+    /// @param headers [in] The status line and header lines as received, ending with
+    /// the blank line. Empty when the reader has none, e.g. a replayed capture.
+    virtual void process_response_headers(const Url_t& page_url, std::string_view headers) {}
+
     /// @brief Called after each page is read. 
     /// This method can be called concurrently by multiple threads.
     /// It is responsible for implementing any necessary concurrency protections. 
@@ -35,13 +90,44 @@ public:
         const Url_t& site_domain, int http_code, int depth,
         const Page_paths_t& page_paths, const Page_content_t& page_content) = 0;
 
+    /// @brief The signature from before Page_content_t was a view, forwarded to the one above.
+    /// It's final, so an override still written against it fails to compile
+    /// rather than never being called.
+    virtual void process_page_content(const Url_t& page_url, 
+        const Url_t& site_domain, int http_code, int depth,
+        const Page_paths_t& page_paths, const std::string& page_content) final {
+        process_page_content(page_url, site_domain, http_code, depth, page_paths,
+            Page_content_t{page_content});
+    }
+
     /// @brief Called after crawling has completed
     virtual void final() = 0;
+
+    /// @brief Set by the crawler for the length of a crawl, and cleared after final().
+    /// Work the processor holds, e.g. buffered records, is charged to it.
+    virtual void set_memory_accountant(Memory_accountant* memory_ptr) {
+        memory_ptr_ = memory_ptr;
+    }
+
+protected:
+    Memory_accountant* memory_ptr_{nullptr};
+
+    /// @brief Sets a charge for memory_processor_work to bytes. 
+    /// Nothing is charged outside a crawl.
+    void charge_work(std::optional<Memory_charge>& charge, size_t bytes) {
+        if (!charge and memory_ptr_) {
+            charge.emplace(*memory_ptr_, memory_processor_work);
+        }
+        if (charge) {
+            charge->resize(bytes);
+        }
+    }
 };
 
 enum Crawl_error_code {
     crawl_error_invalid_url,
-    crawl_error_thread_creation
+    crawl_error_thread_creation,
+    crawl_error_seed_file
 };
 
 struct Crawl_error {
@@ -51,14 +137,88 @@ struct Crawl_error {
 
 using Crawl_result_t = Success_or_error<Crawl_error>;
 
-class Web_crawler
+struct Crawl_budget {
+    // 0 leaves a limit off
+    size_t max_pages{0};
+    // Decoded bytes of the pages read
+    size_t max_bytes{0};
+    std::chrono::milliseconds max_duration{0};
+};
+
+enum Crawl_stop_reason {
+    // The crawl ran out of pages
+    crawl_stop_completed,
+    crawl_stop_page_limit,
+    crawl_stop_byte_limit,
+    crawl_stop_deadline,
+    crawl_stop_cancelled
+};
+
+struct Transfer_stats {
+    // Body bytes received on the wire, possibly compressed
+    size_t wire_bytes;
+    // Body bytes after content decoding
+    size_t decoded_bytes;
+    // Reads aborted after the headers, because the page wasn't HTML or was too big
+    size_t num_aborted_reads;
+    // Body bytes those reads would have transferred, as far as their headers said
+    size_t avoided_bytes;
+};
+
+/// @brief Reads pages for the crawler. 
+/// read_page is called concurrently by the crawling threads, so it must be thread safe.
+template <class Reader_t>
+concept Page_reader = requires(Reader_t& reader, const Url_t& url, const Read_options& options) {
+    { reader.read_page(url, options) } -> std::same_as<Read_Results_t>;
+};
+
+/// @brief Tracks the site's crawled and pending paths, like Url_mgr.
+/// It's created by each crawl and its methods must be thread safe.
+template <class Frontier_t>
+concept Crawl_frontier = 
+    std::constructible_from<Frontier_t, const Deconstructed_url&, bool, const Url_mgr_config&> and
+    requires(Frontier_t& frontier, const Frontier_t& const_frontier, const Url_t& url, 
+        const Page_path_t& path, const Page_paths_t& paths, const Page_content_t& content) {
+    { Frontier_t::deconstruct_url(url) } -> std::same_as<Deconstructed_url>;
+    { const_frontier.site_domain() } -> std::convertible_to<const Url_t&>;
+    { const_frontier.site_page_path() } -> std::convertible_to<const Page_path_t&>;
+    { const_frontier.make_full_url(path) } -> std::convertible_to<Url_t>;
+    { const_frontier.make_seed_path(url) } -> std::convertible_to<Opt_page_path_t>;
+    { const_frontier.extract_child_page_paths(content, path) } -> std::convertible_to<Page_paths_t>;
+    frontier.update_page_paths(paths);
+    frontier.add_seed_paths(paths);
+    { frontier.pop_new_path() } -> std::convertible_to<Opt_page_path_t>;
+    { frontier.num_new_paths() } -> std::convertible_to<int>;
+};
+
+/// @brief Processes the crawled pages, with the same methods as Page_content_processor.
+/// A concrete processor type avoids the virtual calls for each page.
+template <class Processor_t>
+concept Page_processor = requires(Processor_t& processor, const Url_t& url, int http_code, 
+    const Page_paths_t& paths, const Page_content_t& content) {
+    processor.process_page_content(url, url, http_code, http_code, paths, content);
+    processor.final();
+};
+
+/// @brief Multi-threaded website crawler. 
+/// The reader, frontier and page processor are policies resolved at compile time,
+/// so benchmarks and tests can crawl in-memory sites and hot processors can be inlined.
+/// Web_crawler is the crawler with the default policies.
+template <Page_reader Reader_t = Web_page_reader, Crawl_frontier Frontier_t = Url_mgr,
+    Page_processor Processor_t = Page_content_processor>
+class Basic_web_crawler
 {
 public:
     static const int unlimited_depth = INT_LEAST32_MAX;
     /// @brief Multi-threaded website crawler
     /// @param num_treads [in] Number of crawling threads
     /// @param max_depth [in] Maximum crawling depth
-    Web_crawler(int num_treads, int max_depth = unlimited_depth) :
+    Basic_web_crawler(int num_treads, int max_depth = unlimited_depth) :
+        num_treads_(num_treads), max_depth_(max_depth) {}
+    /// @param reader_args [in] Arguments for constructing the reader
+    template <class... Reader_args_t>
+    Basic_web_crawler(int num_treads, int max_depth, Reader_args_t&&... reader_args) :
+        reader_(std::forward<Reader_args_t>(reader_args)...), 
         num_treads_(num_treads), max_depth_(max_depth) {}
 
     /// @brief Crawl the page and its children specified by the URL
@@ -66,27 +226,654 @@ public:
     /// @param page_processor_ptr [in] Customizable page processor
     /// @return Success or error result
     Crawl_result_t crawl(const Url_t& site_url, 
-        Page_content_processor* page_processor_ptr);
+        Processor_t* page_processor_ptr);
+
+    Reader_t& reader() {
+        return reader_;
+    }
+    /// @brief Crawl as one node of a distributed crawl. 
+    /// The crawler only fetches the paths the node owns and forwards the rest.
+    /// @param cluster_node_ptr [in] The started cluster node, or nullptr for a standalone crawl
+    void set_cluster_node(Crawl_cluster_node* cluster_node_ptr) {
+        cluster_node_ptr_ = cluster_node_ptr;
+    }
+
+    /// @brief Bound the memory used by the paths waiting to be crawled. 
+    /// Paths above the budget are spilled to disk.
+    void set_frontier_config(const Frontier_config& frontier_config) {
+        url_mgr_config_.frontier = frontier_config;
+    }
+
+    /// @brief Rules for bringing equivalent URLs to one form before they are deduped
+    void set_canon_rules(const Url_canon_rules& canon_rules) {
+        url_mgr_config_.canon_rules = canon_rules;
+    }
+
+    /// @brief Patterns and limits for the site's URLs that are crawled. 
+    /// Links that fail them are dropped before they reach the frontier.
+    void set_url_rules(const Url_rules_config& rules) {
+        url_mgr_config_.rules = rules;
+    }
+
+    /// @brief Pin the crawling threads to CPUs, e.g. to keep them on one socket.
+    /// The frontier then keeps a shard of the pending paths on each of their NUMA nodes.
+    void set_thread_placement(const Thread_placement& placement) {
+        Cpu_topology topology = Cpu_topology::detect();
+        std::vector<int> cpus = topology.placement_cpus(placement);
+        thread_pool_.set_cpus(cpus);
+        url_mgr_config_.numa_topology.reset();
+        if (!cpus.empty()) {
+            std::vector<Cpu_info> placed_cpus = topology.cpus();
+            std::erase_if(placed_cpus, [&cpus](const Cpu_info& info) {
+                return std::find(cpus.begin(), cpus.end(), info.cpu) == cpus.end(); });
+            url_mgr_config_.numa_topology = Cpu_topology(std::move(placed_cpus));
+        }
+    }
+
+    /// @brief Number of the last crawl's threads that couldn't be pinned to their CPU
+    int num_unpinned_threads() const {
+        return thread_pool_.num_pin_failures();
+    }
+
+    /// @brief Deadline, retry and circuit breaker settings for the hosts read from
+    void set_host_health_config(const Host_health_config& host_health_config) {
+        host_health_config_ = host_health_config;
+    }
+
+    /// @brief Makes the crawl continuous. Every page read is kept in the scheduler 
+    /// and revisited when it's due. Revisits that find the content unchanged
+    /// aren't passed to the processor. The crawl runs until its budget 
+    /// runs out or it's cancelled. 
+    /// @param scheduler_ptr [in] Keeps the pages across crawls, or nullptr for a one-shot crawl
+    void set_revisit_scheduler(Revisit_scheduler* scheduler_ptr) {
+        revisit_ptr_ = scheduler_ptr;
+    }
+
+    /// @brief Start the crawl from the site's URLs in a seed file, one per line,
+    /// as well as the site's page. The file is parsed in parallel on all the CPUs.
+    /// URLs outside the site are skipped.
+    /// @param file_path [in] Empty for no seed file
+    void set_seed_file(const std::string& file_path) {
+        seed_file_ = file_path;
+    }
+
+    /// @brief How the last crawl's seed file loaded
+    const Seed_load_stats& seed_stats() const {
+        return seed_stats_;
+    }
+
+    /// @brief Stop the crawl once it reaches any of the budget's limits.
+    /// The pages being read when a limit is hit are still processed.
+    void set_budget(const Crawl_budget& budget) {
+        budget_ = budget;
+    }
+
+    /// @brief Stops the crawl from another thread. Returns without waiting.
+    /// Transfers in progress are aborted and their pages aren't processed. 
+    /// crawl() then calls the processor's final() and returns.
+    /// A cancel before crawl() gets going stops that crawl as soon as it starts.
+    void cancel() {
+        cancel_latched_ = true;
+        request_stop(crawl_stop_cancelled);
+    }
+
+    /// @brief Why the last crawl ended
+    Crawl_stop_reason stop_reason() const {
+        return stop_reason_;
+    }
+
+    /// @brief Latency and failure statistics for each host read by the crawl
+    std::vector<Host_latency_stats> host_stats() const {
+        return host_health_ptr_ ? host_health_ptr_->stats() : std::vector<Host_latency_stats>{};
+    }
+
+    /// @brief Limit the memory held by pages being read and processed, and by their
+    /// links. Each read reserves fetch_reserve_bytes until its page's size is known,
+    /// and waits while the reservation doesn't fit in the budget. One page is always
+    /// let through, so a page bigger than the budget can't stall the crawl.
+    /// @param budget_bytes [in] 0 is unlimited
+    /// @param fetch_reserve_bytes [in] Memory set aside for each read before its size is known
+    void set_memory_budget(size_t budget_bytes, size_t fetch_reserve_bytes = 1024 * 1024) {
+        memory_.set_budget(budget_bytes);
+        fetch_reserve_bytes_ = fetch_reserve_bytes;
+    }
+
+    /// @brief Processors that queue pages or work charge it here, 
+    /// so it counts against the memory budget. Page_content_processor
+    /// subclasses are handed it for the crawl by set_memory_accountant.
+    Memory_accountant& memory_accountant() {
+        return memory_;
+    }
+
+    /// @brief Current and peak memory use of the crawl
+    Memory_stats memory_stats() const {
+        return memory_.stats();
+    }
+
+    /// @brief Wire versus decoded byte counts for the pages read by the crawl
+    Transfer_stats transfer_stats() const {
+        return Transfer_stats{wire_bytes_, decoded_bytes_, num_aborted_reads_, avoided_bytes_};
+    }
 
 private:
     enum { max_sem_count = 0xfff };
-    using Url_mgr_ptr_t = std::shared_ptr<Url_mgr>;
-    using Thread_pool_ftor_t = Thread_pool_ftor<Web_crawler>;
+    static constexpr auto idle_poll_interval = std::chrono::milliseconds(20);
+    using Frontier_ptr_t = std::shared_ptr<Frontier_t>;
+    using Host_health_ptr_t = std::shared_ptr<Host_health>;
+    using Thread_pool_ftor_t = Thread_pool_ftor<Basic_web_crawler>;
+    using Time_point_t = Host_health::Time_point_t;
+    struct Page_task {
+        Page_path_t path;
+        int num_retries{0};
+    };
+    // A page waiting for a retry
+    struct Deferred_task {
+        Time_point_t ready_time;
+        Page_task task;
+        bool operator>(const Deferred_task& other) const {
+            return ready_time > other.ready_time;
+        }
+    };
+    using Deferred_tasks_t = std::priority_queue<Deferred_task, 
+        std::vector<Deferred_task>, std::greater<Deferred_task>>;
     std::atomic_int num_threads_waiting_to_proc_{0};
     std::counting_semaphore<max_sem_count> proc_wait_sem_{0};    
-    Page_content_processor* page_proc_ptr_{nullptr};
-    Url_mgr_ptr_t url_mgr_ptr_;
+    std::atomic<size_t> wire_bytes_{0};
+    std::atomic<size_t> decoded_bytes_{0};
+    std::atomic<size_t> num_aborted_reads_{0};
+    std::atomic<size_t> avoided_bytes_{0};
+    Reader_t reader_;
+    Processor_t* page_proc_ptr_{nullptr};
+    Crawl_cluster_node* cluster_node_ptr_{nullptr};
+    Url_mgr_config url_mgr_config_;
+    Frontier_ptr_t frontier_ptr_;
+    Host_health_config host_health_config_;
+    Host_health_ptr_t host_health_ptr_;
+    std::mutex deferred_mutex_;
+    Deferred_tasks_t deferred_tasks_;
+    Revisit_scheduler* revisit_ptr_{nullptr};
+    std::string seed_file_;
+    Seed_load_stats seed_stats_;
+    // What the processor uses of each page, from Processor_needs
+    unsigned proc_needs_{processor_needs_all};
+    Memory_accountant memory_;
+    size_t fetch_reserve_bytes_{1024 * 1024};
+    std::atomic_int num_pages_in_flight_{0};
+    Crawl_budget budget_;
+    Time_point_t crawl_deadline_{Time_point_t::max()};
+    std::atomic<size_t> num_pages_started_{0};
+    std::atomic<Crawl_stop_reason> stop_reason_{crawl_stop_completed};
+    std::atomic_bool stopping_{false};
+    // Aborts the reads in progress
+    Read_cancel read_cancel_;
+    // Set by cancel(), so a cancel during crawl()'s setup isn't lost
+    std::atomic_bool cancel_latched_{false};
     int num_treads_;
     int max_depth_;
     Thread_pool thread_pool_;
 
-    bool done_processing() {
+    bool all_threads_waiting() {
         return num_threads_waiting_to_proc_ >= num_treads_;
     }
+    bool done_processing() {
+        // Pages can still be pending while their host is parked or they wait for a retry
+        // A continuous crawl always has pages to revisit
+        return stopping_ or (all_threads_waiting() and frontier_ptr_->num_new_paths() == 0 and
+            !has_deferred_tasks() and (!revisit_ptr_ or revisit_ptr_->num_pages() == 0) and
+            (!cluster_node_ptr_ or cluster_node_ptr_->is_cluster_done()));
+    }
+    void request_stop(Crawl_stop_reason reason);
+    bool is_within_budget(const Page_task& task);
+    bool load_seed_file();
+    bool reserve_page_memory();
+    void release_page_reservation();
+    static size_t page_paths_bytes(const Page_paths_t& paths);
+    // Concrete processors without needs() get every page's links and content
+    unsigned processor_needs() const {
+        if constexpr (requires(const Processor_t& processor) { processor.needs(); }) {
+            return page_proc_ptr_->needs();
+        }
+        else {
+            return processor_needs_all;
+        }
+    }
+    void set_processor_memory(Memory_accountant* memory_ptr) {
+        if constexpr (requires(Processor_t& processor) { 
+            processor.set_memory_accountant(memory_ptr); }) {
+            page_proc_ptr_->set_memory_accountant(memory_ptr);
+        }
+    }
+    void stream_body_chunk(const Url_t& url, size_t offset, Page_content_t chunk) {
+        if constexpr (requires(Processor_t& processor) { 
+            processor.process_body_chunk(url, offset, chunk); }) {
+            page_proc_ptr_->process_body_chunk(url, offset, chunk);
+        }
+    }
+    void pass_response_headers(const Url_t& url, std::string_view headers) {
+        if constexpr (requires(Processor_t& processor) { 
+            processor.process_response_headers(url, headers); }) {
+            page_proc_ptr_->process_response_headers(url, headers);
+        }
+    }
     bool process_next_page();
-    void process_page(const Page_path_t& path);
-    Page_paths_t extract_page_paths(const Page_content_t& content, 
-        const Page_path_t& parent_path);
+    std::optional<Page_task> pop_next_task();
+    Opt_page_path_t pop_next_path();
+    std::optional<Page_task> pop_ready_deferred_task(Time_point_t now);
+    void defer_task(Page_task task, Time_point_t ready_time);
+    bool has_deferred_tasks();
+    bool has_ready_deferred_task();
+    bool has_ready_task();
+    void wait_for_work();
+    void process_page(const Page_task& task);
+    void update_cluster_page_paths(const Page_paths_t& paths);
 };
 
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+Crawl_result_t Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::crawl(
+    const Url_t& site_url, Processor_t* page_processor_ptr) {
+    page_proc_ptr_ = page_processor_ptr;
+    proc_needs_ = processor_needs();
+    Deconstructed_url decon_url = Frontier_t::deconstruct_url(site_url);
+    if (decon_url.domain.empty()) {
+        return Crawl_result_t{Crawl_error{crawl_error_invalid_url, "invalid url"}};
+    }
+    frontier_ptr_ = std::make_shared<Frontier_t>(decon_url, false, url_mgr_config_);
+    host_health_ptr_ = std::make_shared<Host_health>(host_health_config_);
+    num_pages_started_ = 0;
+    num_pages_in_flight_ = 0;
+    num_threads_waiting_to_proc_ = 0;
+    wire_bytes_ = 0;
+    decoded_bytes_ = 0;
+    num_aborted_reads_ = 0;
+    avoided_bytes_ = 0;
+    {
+        std::lock_guard<std::mutex> lock(deferred_mutex_);
+        deferred_tasks_ = Deferred_tasks_t{};
+    }
+    // A stopped crawl leaves permits behind, which would wake this crawl's threads early
+    while (proc_wait_sem_.try_acquire()) {
+    }
+    stop_reason_ = crawl_stop_completed;
+    stopping_ = false;
+    read_cancel_.reset();
+    memory_.reset_stats();
+    crawl_deadline_ = budget_.max_duration.count() == 0 ? Time_point_t::max() :
+        Host_health::Clock_t::now() + budget_.max_duration;
+    // In a distributed crawl only the node that owns the site's page starts with it
+    const Page_path_t& site_page_path = frontier_ptr_->site_page_path();
+    if (!cluster_node_ptr_ or cluster_node_ptr_->owns(site_page_path)) {
+        frontier_ptr_->update_page_paths(Page_paths_t{site_page_path});
+    }
+    if (!seed_file_.empty() and !load_seed_file()) {
+        return Crawl_result_t{Crawl_error{crawl_error_seed_file, "seed file error"}};
+    }
+    // The setup above clears the stop, so a cancel that came in meanwhile is redone
+    if (cancel_latched_) {
+        request_stop(crawl_stop_cancelled);
+    }
+    set_processor_memory(&memory_);
+    try {
+        thread_pool_.run(
+            Thread_pool_ftor_t{&Basic_web_crawler::process_next_page, this}, 
+            num_treads_);
+    }
+    catch (const std::system_error&) {
+        set_processor_memory(nullptr);
+        cancel_latched_ = false;
+        return Crawl_result_t{Crawl_error{crawl_error_thread_creation, "thread creation system error"}};
+    }
+    cancel_latched_ = false;
+    page_proc_ptr_->final();
+    set_processor_memory(nullptr);
+    return Crawl_result_t{};
+}
+
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+bool Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::load_seed_file() {
+    Seed_loader loader;
+    if (!loader.open(seed_file_)) {
+        return false;
+    }
+    const Frontier_t& frontier = *frontier_ptr_;
+    Page_paths_t seed_paths = loader.load([&frontier](const Url_t& url) {
+        return frontier.make_seed_path(url);
+    });
+    seed_stats_ = loader.stats();
+    if (cluster_node_ptr_) {
+        // Every node loads the same file and keeps the seeds it owns
+        std::erase_if(seed_paths, [this](const Page_path_t& path) {
+            return !cluster_node_ptr_->owns(path); });
+    }
+    frontier_ptr_->add_seed_paths(seed_paths);
+    return true;
+}
+
+// This is the top-level function that runs in each page processing thread.
+// It is repeatedly called in its thread until it returns false.
+// It performs multi-threaded coordination of page processing.
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+bool Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::process_next_page() {
+    bool done = false;
+    std::optional<Page_task> opt_task = pop_next_task();
+    if (opt_task and stopping_) {
+        // The crawl stopped while this page waited, drop it
+        release_page_reservation();
+        done = true;
+    }
+    else if (opt_task) {
+        if (has_ready_task() && num_threads_waiting_to_proc_ > 0) { 
+            // More work to do. Release waiting threads to do it.
+            proc_wait_sem_.release();
+        }
+        process_page(*opt_task);
+        --num_pages_in_flight_;
+    }
+    else {
+        ++num_threads_waiting_to_proc_;
+        done = done_processing();
+        if (!done) {
+            wait_for_work();
+            done = done_processing();
+        }
+        if (done) {
+            // All done processing. Make sure any waiting threads are released to exit
+            proc_wait_sem_.release();
+        }
+        else {
+            --num_threads_waiting_to_proc_;
+        }
+    }
+    return !done;
+}
+
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+auto Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::pop_next_task() ->
+    std::optional<Page_task> {
+    std::optional<Page_task> opt_task;
+    Time_point_t now = Host_health::Clock_t::now();
+    // Checked here too, because idle threads poll without popping a task
+    if (now >= crawl_deadline_) {
+        request_stop(crawl_stop_deadline);
+    }
+    // While the host's circuit breaker is open its pages stay where they are
+    const Url_t& host = frontier_ptr_->site_domain();
+    bool is_probe = false;
+    bool is_reserved = false;
+    if (!stopping_ and host_health_ptr_->parked_until(host, now, &is_probe) <= now) {
+        is_reserved = reserve_page_memory();
+        // Idle threads poll too, only a page left waiting is a paused fetch
+        if (!is_reserved and has_ready_task()) {
+            memory_.note_paused_fetch();
+        }
+    }
+    if (is_reserved) {
+        // Retries go first, they have already waited. Then new pages, then due revisits.
+        // The site's new pages run out, but in a continuous crawl revisits never do.
+        opt_task = pop_ready_deferred_task(now);
+        if (!opt_task) {
+            Opt_page_path_t opt_path = pop_next_path();
+            if (!opt_path and revisit_ptr_) {
+                opt_path = revisit_ptr_->pop_due(now);
+            }
+            if (opt_path) {
+                opt_task = Page_task{std::move(*opt_path)};
+            }
+        }
+        if (opt_task and !is_within_budget(*opt_task)) {
+            opt_task.reset();
+        }
+        if (!opt_task) {
+            release_page_reservation();
+        }
+    }
+    if (is_probe and !opt_task) {
+        // Only a read ends the probe, so a thread without a page passes it on
+        host_health_ptr_->return_probe(host);
+    }
+    return opt_task;
+}
+
+// Backpressure: with the memory budget nearly used, threads leave their pages queued.
+// process_page takes over the reservation.
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+bool Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::reserve_page_memory() {
+    bool is_only_page = num_pages_in_flight_++ == 0;
+    if (memory_.try_charge(memory_page_buffers, fetch_reserve_bytes_)) {
+        return true;
+    }
+    if (is_only_page) {
+        memory_.charge(memory_page_buffers, fetch_reserve_bytes_);
+        return true;
+    }
+    --num_pages_in_flight_;
+    return false;
+}
+
+// For a reservation that didn't get a page
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+void Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::release_page_reservation() {
+    memory_.release(memory_page_buffers, fetch_reserve_bytes_);
+    --num_pages_in_flight_;
+}
+
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+size_t Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::page_paths_bytes(
+    const Page_paths_t& paths) {
+    size_t bytes = paths.capacity() * sizeof(Page_path_t);
+    for (const Page_path_t& path: paths) {
+        bytes += path.path.capacity() + path.page.capacity() + path.query.capacity();
+    }
+    return bytes;
+}
+
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+bool Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::is_within_budget(
+    const Page_task& task) {
+    // Only atomic counters are checked for each page
+    if (budget_.max_bytes > 0 and decoded_bytes_ >= budget_.max_bytes) {
+        request_stop(crawl_stop_byte_limit);
+    }
+    // Retries were already counted
+    else if (budget_.max_pages > 0 and task.num_retries == 0 and
+        num_pages_started_++ >= budget_.max_pages) {
+        request_stop(crawl_stop_page_limit);
+    }
+    return !stopping_;
+}
+
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+void Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::request_stop(Crawl_stop_reason reason) {
+    bool was_stopping = stopping_.exchange(true);
+    if (!was_stopping) {
+        stop_reason_ = reason;
+        if (reason == crawl_stop_cancelled) {
+            read_cancel_.cancel();
+        }
+        thread_pool_.stop();
+        // Wake the waiting threads so they see the stop and exit
+        proc_wait_sem_.release(num_treads_);
+    }
+}
+
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+Opt_page_path_t Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::pop_next_path() {
+    Opt_page_path_t opt_path = frontier_ptr_->pop_new_path();
+    if (!opt_path and cluster_node_ptr_) {
+        Page_paths_t received_paths = cluster_node_ptr_->take_received_paths();
+        if (!received_paths.empty()) {
+            frontier_ptr_->update_page_paths(received_paths);
+            opt_path = frontier_ptr_->pop_new_path();
+        }
+    }
+    return opt_path;
+}
+
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+auto Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::pop_ready_deferred_task(Time_point_t now) ->
+    std::optional<Page_task> {
+    std::optional<Page_task> opt_task;
+    std::lock_guard lock(deferred_mutex_);
+    if (!deferred_tasks_.empty() and deferred_tasks_.top().ready_time <= now) {
+        opt_task = deferred_tasks_.top().task;
+        deferred_tasks_.pop();
+    }
+    return opt_task;
+}
+
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+void Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::defer_task(Page_task task, 
+    Time_point_t ready_time) {
+    std::lock_guard lock(deferred_mutex_);
+    deferred_tasks_.push(Deferred_task{ready_time, std::move(task)});
+}
+
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+bool Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::has_deferred_tasks() {
+    std::lock_guard lock(deferred_mutex_);
+    return !deferred_tasks_.empty();
+}
+
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+bool Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::has_ready_deferred_task() {
+    std::lock_guard lock(deferred_mutex_);
+    return !deferred_tasks_.empty() and 
+        deferred_tasks_.top().ready_time <= Host_health::Clock_t::now();
+}
+
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+bool Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::has_ready_task() {
+    return frontier_ptr_->num_new_paths() > 0 or has_ready_deferred_task() or 
+        (revisit_ptr_ and revisit_ptr_->has_due());
+}
+
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+void Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::wait_for_work() {
+    Trace_span span{"wait_for_work"};
+    if (all_threads_waiting()) {
+        // Nothing is ready locally, but retries can come due, a parked host can
+        // recover, and other nodes can still forward paths.
+        // There's no thread left to release this one, so poll for them.
+        std::this_thread::sleep_for(idle_poll_interval);
+    }
+    else {
+        proc_wait_sem_.acquire();
+    }
+}
+
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+void Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::process_page(const Page_task& task) {
+    Trace_span page_span{"process_page"};
+    // Reserved by pop_next_task until the page's size is known
+    Memory_charge page_charge{memory_, memory_page_buffers, fetch_reserve_bytes_, std::adopt_lock};
+    const Page_path_t& path = task.path;
+    const Url_t& host = frontier_ptr_->site_domain();
+    Page_paths_t paths;
+    std::string url_path = frontier_ptr_->make_full_url(path);
+    Read_options read_options;
+    Time_point_t start_time = Host_health::Clock_t::now();
+    read_options.timeout_ms = host_health_ptr_->deadline_ms(host);
+    if (crawl_deadline_ != Time_point_t::max()) {
+        // Don't let a slow read run past the crawl's deadline
+        read_options.timeout_ms = std::clamp<long>(std::chrono::duration_cast<
+            std::chrono::milliseconds>(crawl_deadline_ - start_time).count(), 
+            1, read_options.timeout_ms);
+    }
+    read_options.cancel_ptr = &read_cancel_;
+    bool links_needed = path.depth < max_depth_ or (proc_needs_ & processor_needs_links);
+    // Revisits compare the content to find the pages that changed
+    read_options.discard_body = !links_needed and !revisit_ptr_ and 
+        !(proc_needs_ & processor_needs_body);
+    read_options.keep_headers = proc_needs_ & processor_needs_response_headers;
+    size_t num_streamed_bytes = 0;
+    if (proc_needs_ & processor_needs_body_stream) {
+        read_options.body_chunk_fcn = [&](size_t offset, std::string_view chunk) {
+            num_streamed_bytes += chunk.size();
+            stream_body_chunk(url_path, offset, chunk);
+        };
+    }
+    Read_Results_t results = [&] {
+        Trace_span span{"read_page"};
+        return reader_.read_page(url_path, read_options);
+    }();
+    Time_point_t end_time = Host_health::Clock_t::now();
+    if (results.http_code == http_request_cancelled) {
+        return;
+    }
+    // Mapped content is the reader's, not held by the crawl
+    page_charge.resize(results.content.capacity());
+    wire_bytes_ += results.wire_size;
+    Page_content_t page_content = results.page_content();
+    decoded_bytes_ += page_content.size() + results.discarded_size;
+    if ((proc_needs_ & processor_needs_body_stream) and num_streamed_bytes == 0 and
+        !page_content.empty()) {
+        // The reader doesn't stream, so pass the content in one piece
+        stream_body_chunk(url_path, 0, page_content);
+    }
+    if (results.http_code == http_unsupported_media_type or 
+        results.http_code == http_payload_too_large) {
+        ++num_aborted_reads_;
+        avoided_bytes_ += results.avoided_size;
+    }
+    bool failed = Host_health::is_retryable(results.http_code);
+    host_health_ptr_->record(host, std::chrono::duration_cast<std::chrono::milliseconds>(
+        end_time - start_time), !failed, end_time);
+    if (failed and task.num_retries < host_health_config_.max_retries and !stopping_) {
+        // Retry later rather than holding up this thread
+        defer_task(Page_task{path, task.num_retries + 1}, 
+            end_time + host_health_ptr_->retry_delay(task.num_retries));
+        return;
+    }
+    if (revisit_ptr_) {
+        if (results.http_code != http_ok) {
+            revisit_ptr_->record_failure(path, end_time);
+        }
+        else if (!revisit_ptr_->record_visit(path, page_content, end_time)) {
+            // Unchanged, so are its links
+            return;
+        }
+    }
+    if (results.http_code == http_ok and links_needed) {
+        Trace_span span{"extract_links"};
+        paths = frontier_ptr_->extract_child_page_paths(page_content, path);
+    }
+    Memory_charge links_charge{memory_, memory_link_batches, page_paths_bytes(paths)};
+    if (path.depth < max_depth_ and !paths.empty()) {
+        Trace_span span{"update_frontier"};
+        if (cluster_node_ptr_) {
+            update_cluster_page_paths(paths);
+        }
+        else {
+            frontier_ptr_->update_page_paths(paths);        
+        }
+    }
+    // Free what the processor doesn't use before it runs
+    if (!(proc_needs_ & processor_needs_links)) {
+        Page_paths_t().swap(paths);
+        links_charge.resize(0);
+    }
+    if (!(proc_needs_ & processor_needs_body)) {
+        page_content = Page_content_t{};
+        std::string().swap(results.content);
+        page_charge.resize(0);
+    }
+    Trace_span span{"process_page_content"};
+    if (proc_needs_ & processor_needs_response_headers) {
+        pass_response_headers(url_path, results.headers);
+    }
+    page_proc_ptr_->process_page_content(url_path, frontier_ptr_->site_domain(),
+        results.http_code, path.depth, paths, page_content);
+}
+
+template <Page_reader Reader_t, Crawl_frontier Frontier_t, Page_processor Processor_t>
+void Basic_web_crawler<Reader_t, Frontier_t, Processor_t>::update_cluster_page_paths(
+    const Page_paths_t& paths) {
+    Page_paths_t owned_paths, other_paths;
+    for (const Page_path_t& path: paths) {
+        (cluster_node_ptr_->owns(path) ? owned_paths : other_paths).push_back(path);
+    }
+    frontier_ptr_->update_page_paths(owned_paths);
+    cluster_node_ptr_->forward_paths(other_paths);
+}
 
+extern template class Basic_web_crawler<>;
+using Web_crawler = Basic_web_crawler<>;
@@ -11,9 +11,13 @@ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR I
  ***/
 
 #include <web_page_reader.h>
+#include <page_capture.h>
 #include <common_macros.h>
 #include <atomic>
+#include <algorithm>
 #include <iostream>
+#include <cctype>
+#include <cstdlib>
 
 extern "C" {
 #include <curl/curl.h>
@@ -28,21 +32,44 @@ static void onetime_curl_init() {
     }
 }
 
+// The headers of the response being read. A redirect's headers are followed
+// by the next response's, which replace them.
+struct Response_headers {
+    long status{0};
+    std::optional<size_t> content_length;
+    // From content_type_http_code
+    int content_type_code{http_ok};
+    // With Read_options::keep_headers, the lines as received
+    bool keep_lines{false};
+    std::string lines;
+};
+
+// Where the write callback puts the body
+struct Body_sink {
+    Read_Results_t* results_ptr;
+    const Read_options* options_ptr;
+    size_t num_bytes{0};
+};
+
 class Curl_reader {
 public:
     Curl_reader();
     ~Curl_reader();
-    Read_Results_t read_page(const Url_t& url);
+    Read_Results_t read_page(const Url_t& url, const Read_options& options);
 
 private: 
     CURL* handle_{nullptr};
 
     static size_t copy_curl_read_cb(void *contents, size_t sz, 
         size_t nmemb, void *ctx);
+    static size_t check_curl_header_cb(char* buffer, size_t sz, 
+        size_t nitems, void* ctx);
     void log_error(const char* err_text);
     bool setup_handle();
-    Read_Results_t perform_read(const Url_t& url);
-    int perform_curl_read();
+    Read_Results_t perform_read(const Url_t& url, const Read_options& options);
+    int perform_curl_read(const Response_headers& headers, Read_cancel* cancel_ptr);
+    CURLcode perform_cancellable(Read_cancel& cancel);
+    size_t read_wire_size();
 };
 
 Curl_reader::Curl_reader() {
@@ -59,8 +86,70 @@ Curl_reader::~Curl_reader() {
 size_t Curl_reader::copy_curl_read_cb(void *contents, size_t sz, 
     size_t nmemb, void *ctx) {
     size_t total_size = sz * nmemb;
-    std::string* content_ptr = reinterpret_cast<std::string*>(ctx);
-    content_ptr->append(reinterpret_cast<char*>(contents), total_size);
+    Body_sink* sink_ptr = reinterpret_cast<Body_sink*>(ctx);
+    std::string_view chunk{reinterpret_cast<char*>(contents), total_size};
+    if (sink_ptr->options_ptr->body_chunk_fcn) {
+        sink_ptr->options_ptr->body_chunk_fcn(sink_ptr->num_bytes, chunk);
+    }
+    sink_ptr->num_bytes += total_size;
+    if (sink_ptr->options_ptr->discard_body) {
+        sink_ptr->results_ptr->discarded_size += total_size;
+    }
+    else {
+        sink_ptr->results_ptr->content.append(chunk);
+    }
+    return total_size;
+}
+
+static bool header_name_is(std::string_view line, std::string_view name) {
+    return line.size() > name.size() and line[name.size()] == ':' and
+        std::equal(name.begin(), name.end(), line.begin(), [](char name_c, char line_c) {
+            return name_c == std::tolower(static_cast<unsigned char>(line_c)); });
+}
+
+static std::string_view header_value(std::string_view line) {
+    line.remove_prefix(line.find(':') + 1);
+    size_t begin_pos = line.find_first_not_of(" \t");
+    size_t end_pos = line.find_last_not_of(" \t\r\n");
+    return begin_pos == std::string_view::npos ? std::string_view{} :
+        line.substr(begin_pos, end_pos - begin_pos + 1);
+}
+
+// libcurl calls this for each header line, before any of the body is read.
+// Returning less than the line's size aborts the transfer.
+size_t Curl_reader::check_curl_header_cb(char* buffer, size_t sz, 
+    size_t nitems, void* ctx) {
+    size_t total_size = sz * nitems;
+    Response_headers* headers_ptr = reinterpret_cast<Response_headers*>(ctx);
+    std::string_view line{buffer, total_size};
+    if (line.rfind("HTTP/", 0) == 0) {
+        bool keep_lines = headers_ptr->keep_lines;
+        *headers_ptr = Response_headers{};
+        headers_ptr->keep_lines = keep_lines;
+        size_t code_pos = line.find(' ');
+        if (code_pos != std::string_view::npos) {
+            headers_ptr->status = std::strtol(line.data() + code_pos + 1, nullptr, 10);
+        }
+    }
+    // Redirects and errors have their own bodies, which are small
+    else if (headers_ptr->status >= 200 and headers_ptr->status < 300) {
+        if (header_name_is(line, "content-length")) {
+            headers_ptr->content_length = std::strtoull(
+                std::string{header_value(line)}.c_str(), nullptr, 10);
+        }
+        else if (header_name_is(line, "content-type")) {
+            headers_ptr->content_type_code = content_type_http_code(header_value(line));
+        }
+        // The blank line that ends the headers. Content-Length can follow Content-Type.
+        else if (line == "\r\n" or line == "\n") {
+            if (headers_ptr->content_type_code != http_ok) {
+                return 0;
+            }
+        }
+    }
+    if (headers_ptr->keep_lines) {
+        headers_ptr->lines.append(line);
+    }
     return total_size;
 }
 
@@ -68,9 +157,9 @@ void Curl_reader::log_error(const char* err_text) {
     std::cout << "curl error:" << err_text << std::endl;
 }
 
-Read_Results_t Curl_reader::read_page(const Url_t& url) {
+Read_Results_t Curl_reader::read_page(const Url_t& url, const Read_options& options) {
     if (setup_handle()) {
-        return perform_read(url);
+        return perform_read(url, options);
     }
     else {
         return Read_Results_t{http_internal_error, ""};
@@ -87,13 +176,12 @@ bool Curl_reader::setup_handle() {
             CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS) != CURLE_OK, 
             error, log_error("curl setting HTTP version"))
 
-        // For completeness
+        // An empty string advertises every content coding this libcurl build
+        // can decode (gzip, deflate, br, zstd). Decoding is streamed into the
+        // write callback, so the page buffer only ever holds decoded content.
         IF_COND_ASSIGN_PROC_EXIT_LOOP(curl_easy_setopt(handle_,
-            CURLOPT_ACCEPT_ENCODING, "text/html") != CURLE_OK, 
+            CURLOPT_ACCEPT_ENCODING, "") != CURLE_OK, 
             error, log_error("curl setting CURLOPT_ACCEPT_ENCODING"))
-        IF_COND_ASSIGN_PROC_EXIT_LOOP(curl_easy_setopt(handle_,
-            CURLOPT_TIMEOUT, 5L) != CURLE_OK, 
-            error, log_error("curl setting CURLOPT_TIMEOUT"))
         IF_COND_ASSIGN_PROC_EXIT_LOOP(curl_easy_setopt(handle_,
             CURLOPT_FOLLOWLOCATION, 1L) != CURLE_OK, 
             error, log_error("curl setting CURLOPT_FOLLOWLOCATION"))
@@ -113,16 +201,6 @@ bool Curl_reader::setup_handle() {
             CURLOPT_MAXREDIRS, 10L) != CURLE_OK, 
             error, log_error("curl setting CURLOPT_MAXREDIRS"))
 
-        // Limit page load time to 20s
-        IF_COND_ASSIGN_PROC_EXIT_LOOP(curl_easy_setopt(handle_,
-            CURLOPT_TIMEOUT_MS, 20000L) != CURLE_OK, 
-            error, log_error("curl setting CURLOPT_TIMEOUT_MS"))
-
-        // Connect fast or fail
-        IF_COND_ASSIGN_PROC_EXIT_LOOP(curl_easy_setopt(handle_,
-            CURLOPT_CONNECTTIMEOUT_MS, 4000L) != CURLE_OK, 
-            error, log_error("curl setting CURLOPT_CONNECTTIMEOUT_MS"))
-
         // Limit loads to < 10 MB
         IF_COND_ASSIGN_PROC_EXIT_LOOP(curl_easy_setopt(handle_,
             CURLOPT_MAXFILESIZE_LARGE, (curl_off_t)10*1024*1024) != CURLE_OK, 
@@ -145,31 +223,103 @@ bool Curl_reader::setup_handle() {
     return !error;
 }
 
-Read_Results_t Curl_reader::perform_read(const Url_t& url) {
+Read_Results_t Curl_reader::perform_read(const Url_t& url, const Read_options& options) {
     Read_Results_t result{http_internal_error, ""};
+    Response_headers headers;
+    headers.keep_lines = options.keep_headers;
+    Body_sink body_sink{&result, &options};
     bool error = false;
     BEGIN_COND_LOOP
         IF_COND_ASSIGN_PROC_EXIT_LOOP(curl_easy_setopt(handle_,
             CURLOPT_URL, url.c_str()) != CURLE_OK, 
             error, log_error("curl setting CURLOPT_URL"))
+
+        // The deadlines are per request, so they can adapt to the host's latency
+        IF_COND_ASSIGN_PROC_EXIT_LOOP(curl_easy_setopt(handle_,
+            CURLOPT_TIMEOUT_MS, options.timeout_ms) != CURLE_OK, 
+            error, log_error("curl setting CURLOPT_TIMEOUT_MS"))
+        // Connect fast or fail
+        IF_COND_ASSIGN_PROC_EXIT_LOOP(curl_easy_setopt(handle_,
+            CURLOPT_CONNECTTIMEOUT_MS, std::min(options.connect_timeout_ms, 
+                options.timeout_ms)) != CURLE_OK, 
+            error, log_error("curl setting CURLOPT_CONNECTTIMEOUT_MS"))
         IF_COND_ASSIGN_PROC_EXIT_LOOP(curl_easy_setopt(handle_,
             CURLOPT_WRITEFUNCTION, copy_curl_read_cb) != CURLE_OK,
             error, log_error("curl setting CURLOPT_WRITEFUNCTION"))
         IF_COND_ASSIGN_PROC_EXIT_LOOP(curl_easy_setopt(handle_,
-            CURLOPT_WRITEDATA, reinterpret_cast<void*>(&result.content)) != CURLE_OK, 
+            CURLOPT_WRITEDATA, reinterpret_cast<void*>(&body_sink)) != CURLE_OK, 
             error, log_error("curl setting CURLOPT_WRITEDATA"))
+        IF_COND_ASSIGN_PROC_EXIT_LOOP(curl_easy_setopt(handle_,
+            CURLOPT_HEADERFUNCTION, check_curl_header_cb) != CURLE_OK,
+            error, log_error("curl setting CURLOPT_HEADERFUNCTION"))
+        IF_COND_ASSIGN_PROC_EXIT_LOOP(curl_easy_setopt(handle_,
+            CURLOPT_HEADERDATA, reinterpret_cast<void*>(&headers)) != CURLE_OK, 
+            error, log_error("curl setting CURLOPT_HEADERDATA"))
     END_COND_LOOP
+    if (!error and options.cancel_ptr and options.cancel_ptr->is_cancelled()) {
+        return Read_Results_t{http_request_cancelled, ""};
+    }
     
     if (!error) {
-        result.http_code = perform_curl_read();
+        result.http_code = perform_curl_read(headers, options.cancel_ptr);
+        result.wire_size = read_wire_size();
+        if ((result.http_code == http_unsupported_media_type or 
+            result.http_code == http_payload_too_large) and headers.content_length) {
+            result.avoided_size = *headers.content_length;
+        }
+        result.headers = std::move(headers.lines);
     }
 
     return result;
 }
 
-int Curl_reader::perform_curl_read() {
+// Runs the transfer on a multi handle, which curl_multi_wakeup can interrupt,
+// so a cancel doesn't wait for the transfer's next data or progress callback
+CURLcode Curl_reader::perform_cancellable(Read_cancel& cancel) {
+    CURLM* multi_handle = curl_multi_init();
+    if (multi_handle == nullptr or curl_multi_add_handle(multi_handle, handle_) != CURLM_OK) {
+        log_error("curl init multi handle");
+        if (multi_handle) {
+            curl_multi_cleanup(multi_handle);
+        }
+        return CURLE_FAILED_INIT;
+    }
+    int wakeup_id = cancel.add_wakeup([multi_handle] { curl_multi_wakeup(multi_handle); });
+    CURLcode curl_code = CURLE_OK;
+    int num_running = 1;
+    while (num_running > 0) {
+        if (cancel.is_cancelled()) {
+            curl_code = CURLE_ABORTED_BY_CALLBACK;
+            break;
+        }
+        if (curl_multi_perform(multi_handle, &num_running) != CURLM_OK) {
+            curl_code = CURLE_RECV_ERROR;
+            break;
+        }
+        // Returns when the transfer has work, on a wakeup, or after the timeout
+        if (num_running > 0 and 
+            curl_multi_poll(multi_handle, nullptr, 0, 1000, nullptr) != CURLM_OK) {
+            curl_code = CURLE_RECV_ERROR;
+            break;
+        }
+    }
+    if (num_running == 0) {
+        int num_msgs;
+        CURLMsg* msg_ptr = curl_multi_info_read(multi_handle, &num_msgs);
+        curl_code = (msg_ptr and msg_ptr->msg == CURLMSG_DONE) ? msg_ptr->data.result : 
+            CURLE_RECV_ERROR;
+    }
+    // Removed before the multi handle goes, a concurrent cancel may be using it
+    cancel.remove_wakeup(wakeup_id);
+    curl_multi_remove_handle(multi_handle, handle_);
+    curl_multi_cleanup(multi_handle);
+    return curl_code;
+}
+
+int Curl_reader::perform_curl_read(const Response_headers& headers, Read_cancel* cancel_ptr) {
     int http_code = http_internal_error;
-    CURLcode curl_code = curl_easy_perform(handle_);
+    CURLcode curl_code = cancel_ptr ? perform_cancellable(*cancel_ptr) : 
+        curl_easy_perform(handle_);
     switch (curl_code) {
         case CURLE_OK: {
             long curl_http_status;
@@ -183,6 +333,20 @@ int Curl_reader::perform_curl_read() {
             http_code = http_request_timeout;
             break;
         }
+        case CURLE_WRITE_ERROR: {
+            http_code = headers.content_type_code != http_ok ? headers.content_type_code 
+                : http_internal_error;
+            break;
+        }
+        // A Content-Length over CURLOPT_MAXFILESIZE_LARGE stops the transfer before the body
+        case CURLE_FILESIZE_EXCEEDED: {
+            http_code = http_payload_too_large;
+            break;
+        }
+        case CURLE_ABORTED_BY_CALLBACK: {
+            http_code = http_request_cancelled;
+            break;
+        }
         default: {
             http_code = http_internal_error;
             break;
@@ -191,8 +355,30 @@ int Curl_reader::perform_curl_read() {
     return http_code;
 }
 
+// libcurl counts body bytes as they arrive, before content decoding
+size_t Curl_reader::read_wire_size() {
+    curl_off_t wire_size = 0;
+    CURLcode res = curl_easy_getinfo(handle_, 
+        CURLINFO_SIZE_DOWNLOAD_T, &wire_size);
+    return (res == CURLE_OK and wire_size > 0) ? static_cast<size_t>(wire_size) : 0;
+}
 
-Read_Results_t Web_page_reader::read_page(const std::string& url) {
+Read_Results_t Web_page_reader::read_page(const std::string& url, const Read_options& options) {
     Curl_reader curl_reader;
-    return curl_reader.read_page(url);
+    if (!capture_ptr_) {
+        return curl_reader.read_page(url, options);
+    }
+    // The recording keeps every body, so replays can serve any processor
+    Read_options capture_options = options;
+    capture_options.discard_body = false;
+    Read_Results_t results = curl_reader.read_page(url, capture_options);
+    // A cancelled read says nothing about the page
+    if (results.http_code != http_request_cancelled) {
+        capture_ptr_->append(url, results);
+    }
+    if (options.discard_body) {
+        results.discarded_size = results.content.size();
+        std::string().swap(results.content);
+    }
+    return results;
 }
\ No newline at end of file
@@ -13,14 +13,123 @@ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR I
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <algorithm>
+#include <cctype>
+#include <optional>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <functional>
 #include <web_common.h>
 
+class Page_capture_writer;
+
 struct Read_Results_t {
     int http_code;
     std::string content;
+    // Body bytes received on the wire, before any content decoding
+    size_t wire_size{0};
+    // Content that the reader keeps in memory, so it isn't copied to content
+    std::optional<std::string_view> mapped_content{};
+    // Body bytes the server would have sent for a response that was aborted
+    // after its headers, when it gave a Content-Length
+    size_t avoided_size{0};
+    // Decoded body bytes that were read but not kept, with Read_options::discard_body
+    size_t discarded_size{0};
+    // The final response's status line and header lines as received, ending with
+    // the blank line, with Read_options::keep_headers. A redirect's aren't kept.
+    std::string headers{};
+
+    Page_content_t page_content() const {
+        return mapped_content ? *mapped_content : Page_content_t{content};
+    }
+};
+
+/// @brief Cancels reads from another thread. A read that waits on the network 
+/// adds a wakeup, so it sees the cancel right away instead of after its wait.
+class Read_cancel {
+public:
+    using Wakeup_fcn_t = std::function<void()>;
+
+    void cancel() {
+        std::lock_guard lock(mutex_);
+        cancelled_ = true;
+        for (const auto& [id, wakeup_fcn]: wakeups_) {
+            wakeup_fcn();
+        }
+    }
+    void reset() {
+        cancelled_ = false;
+    }
+    bool is_cancelled() const {
+        return cancelled_;
+    }
+    /// @brief Calls wakeup_fcn on cancel() until the wakeup is removed.
+    /// Check is_cancelled() after adding it, a cancel can come first.
+    /// @return The id to remove the wakeup with
+    int add_wakeup(Wakeup_fcn_t wakeup_fcn) {
+        std::lock_guard lock(mutex_);
+        wakeups_.emplace_back(next_wakeup_id_, std::move(wakeup_fcn));
+        return next_wakeup_id_++;
+    }
+    void remove_wakeup(int wakeup_id) {
+        std::lock_guard lock(mutex_);
+        std::erase_if(wakeups_, [wakeup_id](const auto& wakeup) { 
+            return wakeup.first == wakeup_id; });
+    }
+
+private:
+    std::atomic_bool cancelled_{false};
+    std::mutex mutex_;
+    std::vector<std::pair<int, Wakeup_fcn_t>> wakeups_;
+    int next_wakeup_id_{0};
+};
+
+struct Read_options {
+    // Deadline for the whole transfer, including connecting
+    long timeout_ms{20000};
+    long connect_timeout_ms{4000};
+    // The read is aborted when this is cancelled. nullptr can't cancel.
+    Read_cancel* cancel_ptr{nullptr};
+    // Called with each piece of the decoded body as it's read, or empty.
+    // offset is the piece's position in the body.
+    std::function<void(size_t offset, std::string_view chunk)> body_chunk_fcn;
+    // Read the body without keeping it in content, e.g. when it's only streamed
+    bool discard_body{false};
+    // Keep the response's header lines in Read_Results_t::headers
+    bool keep_headers{false};
 };
 
+/// @brief The media type of a Content-Type header value, lowercased and 
+/// without its parameters, e.g. "text/html" for "Text/HTML; charset=UTF-8"
+inline std::string content_media_type(std::string_view content_type) {
+    std::string media_type{content_type.substr(0, content_type.find(';'))};
+    std::transform(media_type.begin(), media_type.end(), media_type.begin(),
+        [](unsigned char c) { return std::tolower(c); });
+    media_type.erase(0, media_type.find_first_not_of(" \t"));
+    media_type.erase(media_type.find_last_not_of(" \t") + 1);
+    return media_type;
+}
+
+/// @brief The code a read gets for a response with this Content-Type.
+/// Only pages the processors can parse for links are worth downloading,
+/// the others are aborted after their headers.
+/// @return http_ok to read the body, else http_unsupported_media_type.
+/// An empty type is read, servers often leave it out.
+inline int content_type_http_code(std::string_view content_type) {
+    std::string media_type = content_media_type(content_type);
+    return (media_type.empty() or media_type == "text/html" or 
+        media_type == "application/xhtml+xml") ? http_ok : http_unsupported_media_type;
+}
+
 class Web_page_reader {
 public:
-    Read_Results_t read_page(const Url_t& url);
+    /// @param capture_ptr [in] Records every page that is read, or nullptr
+    Web_page_reader(Page_capture_writer* capture_ptr = nullptr) : capture_ptr_(capture_ptr) {}
+    Read_Results_t read_page(const Url_t& url, const Read_options& options = Read_options{});
+
+private:
+    Page_capture_writer* capture_ptr_;
 };